@@ -9,273 +9,2961 @@
 #include <vector>
 #include <array>
 #include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <climits>
+#include <pthread.h>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <new>
 using namespace std;
 
-int MEMSIZE = 512;  // The maximum size of memory
-int PROGSIZE;       // Size of each program in pages
-int SOP;            // Size of pages
+int MEMSIZE = 512;          // The maximum size of memory
+int PREFETCH_DEPTH = 8;     // Most pages pre-paging brings in on one fault
+
+// How frames are shared between programs
+//   LOCAL            each program keeps an equal share and only replaces its own pages
+//   GLOBAL           one policy over every page in memory, a fault can take a frame from any program
+//   WORKING_SET      each program is entitled to as many frames as the distinct pages in its last WS_WINDOW references
+//   FAULT_FREQUENCY  a program's share grows when it faults within PFF_LOW references and shrinks past PFF_HIGH without one
+// Under the last two, a fault takes a frame from the program holding the most frames beyond its share, and no program is
+// taken below MIN_FRAMES. When the working sets add up to more than memory, programs are swapped out until the rest fit.
+enum Allocation { LOCAL, GLOBAL, WORKING_SET, FAULT_FREQUENCY };
+Allocation ALLOCATION = LOCAL;
+int WS_WINDOW = 1000;       // References of a program its working set is taken over
+int PFF_LOW = 5;            // A program faulting again within this many of its references gets another frame
+int PFF_HIGH = 50;          // A program going this many references without a fault gives one up
+int MIN_FRAMES = 4;         // Frames another program's fault can't take a program below, under ws and pff
+
+// Translation cost model, left out while TLB_ENTRIES is 0
+int TLB_ENTRIES = 0;        // Entries in the TLB
+int TLB_WAYS = 4;           // Entries in each set of the TLB
+int WALK_BITS = 9;          // Bits of the page number translated by each level of the page table
+int TLB_CYCLES = 1;         // Cost of a TLB lookup
+int WALK_CYCLES = 25;       // Cost of reading one level of the page table on a TLB miss
+int FAULT_CYCLES = 100000;  // Cost of a page fault
 
 // If this value is true, all debug statements are printed.
-bool DEBUG = false;
+const bool DEBUG = false;
+
+// Heap allocations so far, for the suite's allocations per fault. Counting them replaces the global operator new and puts an
+// atomic add on every allocation, so it's only built in with -DCOUNT_ALLOCATIONS. Otherwise the suite shows "-" instead.
+std::atomic<unsigned long> ALLOCATIONS(0);
+
+#ifdef COUNT_ALLOCATIONS
+const bool COUNTING_ALLOCATIONS = true;
+
+void* operator new(size_t size){
+    ALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size > 0 ? size : 1);
+    if (p == NULL) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept{
+    ALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size > 0 ? size : 1);
+}
+
+// Kept out of line so the compiler doesn't see free() meeting memory from operator new and warn about a mismatch
+__attribute__((noinline)) void operator delete(void* p) noexcept{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, const std::nothrow_t&) noexcept{
+    free(p);
+}
+#else
+const bool COUNTING_ALLOCATIONS = false;
+#endif
+
+// A single trace record: the program it belongs to and the memory location it references
+struct Reference{
+    int pid;
+    unsigned long address;
+};
 
-// Global Variables
-unsigned long RCOUNT = 0;   // Increments when any virtual memory is referenced
-unsigned long VCOUNT = 1;   // Increments when valid bit is set to 1
-unsigned long PSCOUNT = 0;  // Increments when pages are swapped
-unsigned long PCOUNT = 0;   // Increments when a virtual page is created
+// A single plist entry: the program ID and its size in memory locations
+struct Process{
+    int id;
+    unsigned long size;
+};
 
+// Frame table shared by every program. Under local allocation runParallel simulates programs on different threads at once,
+// which is safe because after setup a program only takes a free frame while it has fewer than its share (runParallel
+// checks that none can), and otherwise only swaps pages within its own frames. Each frame's entries are then written by
+// the thread of the program owning it, and allocate() is never called during the run.
 class PhysicalMemory{
     private:
-        std::vector<unsigned long> pageFrames;
-        std::map<unsigned long, unsigned long> hashtable;
+        std::vector<unsigned long> pageFrames;  // Page number held by each frame
+        std::vector<int> owners;                // Program using each frame, -1 if it's free
+        std::vector<int> freeFrames;            // Frames nobody has been given yet, lowest at the back
     public:
-        void initPhysicalMemory(){
+        void initPhysicalMemory(int SOP){
             int size = float(MEMSIZE)/float(SOP);
-            pageFrames.resize(size, 0);
+            pageFrames.assign(size, 0);
+            owners.assign(size, -1);
+            freeFrames.clear();
+            for (int i = size - 1; i >= 0; i--) freeFrames.push_back(i);
+        }
+
+        int size(){
+            return pageFrames.size();
+        }
+
+        bool hasFree(){
+            return !freeFrames.empty();
+        }
+
+        // Takes a free frame
+        int allocate(){
+            int frame = freeFrames.back();
+            freeFrames.pop_back();
+            return frame;
+        }
+
+        int getOwner(int pageFrame){
+            return owners[pageFrame];
         }
 
         // Prints out all of memory
         void print(){
-            for (int i = 0; i < pageFrames.size(); i++){
-                std::cout << i << " " << pageFrames[i] << std::endl;
+            for (size_t i = 0; i < pageFrames.size(); i++){
+                std::cout << i << " " << owners[i] << " " << pageFrames[i] << std::endl;
             }
         }
 
-        // Swaps in the given Virtual Memory address into a physical memory address.
-        void swapIn(unsigned long virtualPage, int processid, int pageNumber){
-            unsigned long pageFrame = processid*PROGSIZE+pageNumber;
+        // Swaps in the given Virtual Memory address into a physical memory address, which now belongs to the given program.
+        void swapIn(unsigned long virtualPage, int pageFrame, int owner){
             pageFrames[pageFrame] = virtualPage;
-            hashtable[virtualPage] = pageFrame;
+            owners[pageFrame] = owner;
         }
+};
+
+// Position used for pages that are never referenced again
+const unsigned long NEVER = ~0UL;
+
+// Next reference index for offline policies, built in one backward pass over a trace at a given page size
+struct NextUse{
+    std::vector<unsigned long> next;                    // next[i] is the position of the next reference to the page referenced at i
+    std::vector<std::vector<unsigned long>> first;      // first[pid][page] is the position of the first reference to that page
 
-        unsigned long findPhysical(unsigned long virtualPage){
-            return hashtable[virtualPage];
+    void build(const std::vector<Process>& processes, const std::vector<Reference>& trace, int SOP){
+        first.resize(processes.size());
+        for (size_t i = 0; i < processes.size(); i++) first[i].assign((processes[i].size + SOP - 1)/SOP, NEVER);
+        next.resize(trace.size());
+        for (size_t i = trace.size(); i-- > 0;){
+            int pid = trace[i].pid;
+            unsigned long page = trace[i].address/SOP;
+            if ((size_t)pid >= first.size()) first.resize(pid + 1);
+            if (page >= first[pid].size()) first[pid].resize(page + 1, NEVER);
+            next[i] = first[pid][page];
+            first[pid][page] = i;
         }
+    }
+};
+
+// Counters and memory shared by all the page tables of one simulation.
+// Every simulation owns one of these, so several simulations can run on different threads.
+// Translation counts. Every reference is looked up in the TLB, and each miss walks the page table.
+struct TranslationStats{
+    unsigned long lookups = 0;
+    unsigned long hits = 0;
+    unsigned long walks = 0;
+    unsigned long levels = 0;   // Page table levels read by all the walks
 };
 
-PhysicalMemory MAINMEM;
+// Tag of an unused TLB entry
+const unsigned long EMPTY_ENTRY = ~0UL;
 
-// Page table for each program, a vector of arrays (size 3), where each vector index is a page.
-// 1st array index is the page number (unique among all pages in all tables). We can use  the vector index to find the local page number for each program's page table
-// 2nd array index is the valid bit, 0 if not in memory, 1 if in memory
-// 3rd array index is the last recently accessed count in FIFO and LRU, it'll be the reference bit in the clock algorithm
-class PageTable{
+// Set-associative TLB over page numbers. Page numbers are unique across programs, so it never needs flushing between them.
+// Each set is kept most recently used first and replaces its least recently used entry.
+class TLB{
     private:
-        int id;                 // Process ID
-        unsigned long hand;     // Clock Hand
-        std::vector<std::array<unsigned long, 3>> pages;
+        std::vector<unsigned long> tags;    // ways entries for each set in turn
+        int sets, ways;
     public:
-        PageTable(int id, int numPages) : id(id){
-            pages.resize(numPages);
+        TranslationStats stats;
+
+        TLB() : sets(0), ways(1){}
+
+        void init(int entries, int associativity){
+            ways = std::max(1, std::min(associativity, entries));
+            sets = entries/ways;
+            tags.assign(sets*ways, EMPTY_ENTRY);
+        }
+
+        bool enabled(){
+            return sets > 0;
+        }
+
+        // Looks a page up, making it the most recent entry of its set on a hit
+        bool lookup(unsigned long page){
+            ++stats.lookups;
+            unsigned long* set = &tags[(page % sets)*ways];
+            for (int i = 0; i < ways; i++){
+                if (set[i] == page){
+                    for (; i > 0; i--) set[i] = set[i - 1];
+                    set[0] = page;
+                    ++stats.hits;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Caches a translation found by a walk, pushing out the least recent entry of its set
+        void insert(unsigned long page){
+            unsigned long* set = &tags[(page % sets)*ways];
+            for (int i = ways - 1; i > 0; i--) set[i] = set[i - 1];
+            set[0] = page;
+        }
+
+        // Drops the translation of a page leaving memory
+        void invalidate(unsigned long page){
+            unsigned long* set = &tags[(page % sets)*ways];
+            for (int i = 0; i < ways; i++){
+                if (set[i] == page){
+                    for (; i < ways - 1; i++) set[i] = set[i + 1];
+                    set[ways - 1] = EMPTY_ENTRY;
+                    return;
+                }
+            }
+        }
+};
+
+// Estimated cycles spent translating: a TLB lookup for every reference, the page table levels read on misses, and the faults
+double translationCycles(const TranslationStats& stats, unsigned long faults){
+    return double(stats.lookups)*TLB_CYCLES + double(stats.levels)*WALK_CYCLES + double(faults)*FAULT_CYCLES;
+}
+
+struct SimState{
+    int PROGSIZE;               // Frames each program starts with, and keeps under local allocation
+    Allocation ALLOC;
+    int SOP;                    // Size of pages
+    unsigned long RCOUNT = 0;   // Increments when any virtual memory is referenced
+    unsigned long PSCOUNT = 0;  // Increments when pages are swapped
+    unsigned long PCOUNT = 0;   // Increments when a virtual page is created
+    PhysicalMemory MAINMEM;
+    NextUse* future = NULL;     // Only built for offline policies
+    TLB tlb;                    // Only enabled when TLB_ENTRIES is set
+};
+
+// Replacement policies. A policy only orders resident pages, the simulation does the swapping. Each page table has its own,
+// except under global allocation where one policy orders every page by its number.
+//   init(numPages, frames)  pages are numbered 0 to numPages-1, and at most frames of them are in memory at once
+//   hit(page, next)         a resident page was referenced
+//   evict(incoming)         memory is full and incoming is about to be loaded: remove a page from the policy and return it.
+//                           incoming is -1 when the frame goes to another program's page.
+//   load(page, next)        a page was brought into memory
+// next is the position of the page's next reference. It's only worked out for policies with OFFLINE set, and is 0 otherwise.
+// They are template parameters of PageTable so the policy is picked once at startup and inlined into the reference loop.
+
+// Evicts the page that was loaded first
+class FIFOPolicy{
+    private:
+        std::vector<int> queue;     // Resident pages in load order, used as a ring buffer
+        size_t head, count;
+    public:
+        static const bool OFFLINE = false;
+        static const char* name(){ return "FIFO"; }
+
+        void init(int numPages, int){
+            queue.resize(numPages);
+            head = count = 0;
+        }
+
+        void hit(int, unsigned long){}
+
+        void load(int page, unsigned long){
+            queue[(head + count++) % queue.size()] = page;
+        }
+
+        int evict(int){
+            int page = queue[head];
+            head = (head + 1) % queue.size();
+            --count;
+            return page;
+        }
+};
+
+// Evicts the page that was referenced longest ago. Resident pages are kept in a doubly linked list through prev/next, most recent first.
+class LRUPolicy{
+    private:
+        std::vector<int> prev, next;
+        int head, tail;
+
+        void unlink(int page){
+            if (prev[page] >= 0) next[prev[page]] = next[page];
+            else head = next[page];
+            if (next[page] >= 0) prev[next[page]] = prev[page];
+            else tail = prev[page];
+        }
+
+        void pushFront(int page){
+            prev[page] = -1;
+            next[page] = head;
+            if (head >= 0) prev[head] = page;
+            else tail = page;
+            head = page;
+        }
+    public:
+        static const bool OFFLINE = false;
+        static const char* name(){ return "LRU"; }
+
+        void init(int numPages, int){
+            prev.assign(numPages, -1);
+            next.assign(numPages, -1);
+            head = tail = -1;
+        }
+
+        void hit(int page, unsigned long){
+            if (page == head) return;
+            unlink(page);
+            pushFront(page);
+        }
+
+        void load(int page, unsigned long){
+            pushFront(page);
+        }
+
+        int evict(int){
+            int page = tail;
+            unlink(page);
+            return page;
+        }
+};
+
+// Second chance: the hand sweeps the resident pages, clearing reference bits, and evicts the first page whose bit is already clear
+class ClockPolicy{
+    private:
+        std::vector<int> ring;              // Resident pages in the order the hand visits them, -1 for an empty slot
+        std::vector<unsigned char> referenced;
+        size_t hand;
+        std::vector<int> freeSlots;         // Slots emptied by evictions, refilled by the next loads
+    public:
+        static const bool OFFLINE = false;
+        static const char* name(){ return "Clock"; }
+
+        void init(int numPages, int){
+            ring.clear();
+            referenced.assign(numPages, 0);
             hand = 0;
-            for (int i = 0; i < numPages; i++){
-                pages[i][0] = PCOUNT++;
-                pages[i][1] = 0;
-                pages[i][2] = 0;
+            freeSlots.clear();
+        }
+
+        void hit(int page, unsigned long){
+            referenced[page] = 1;
+        }
+
+        void load(int page, unsigned long){
+            referenced[page] = 1;
+            if (!freeSlots.empty()){
+                ring[freeSlots.back()] = page;
+                freeSlots.pop_back();
+            }else ring.push_back(page);
+        }
+
+        int evict(int){
+            while (ring[hand] < 0 || referenced[ring[hand]]){
+                if (ring[hand] >= 0) referenced[ring[hand]] = 0;
+                hand = (hand + 1) % ring.size();
             }
+            int page = ring[hand];
+            ring[hand] = -1;
+            freeSlots.push_back(hand);
+            hand = (hand + 1) % ring.size();
+            return page;
         }
+};
 
-        // Use to check the page tables at a certain point
-        void print(){
-            std::cout << "Process ID: " << id << std::endl;
-            for (int i = 0; i < pages.size(); i++){
-                std::cout << pages[i][0] << " " << pages[i][1] << " " << pages[i][2] << std::endl;
+// Belady's optimal replacement: evicts the page whose next reference is farthest away.
+// It needs the whole trace up front, the next use of every page comes from a NextUse index.
+// Resident pages sit in an indexed max heap keyed on next use, so each hit, load or eviction is O(log k) for k frames.
+class OPTPolicy{
+    private:
+        std::vector<int> heap;              // Resident pages, the page used farthest in the future at the top
+        std::vector<int> position;          // Index of each page in heap, -1 if not resident
+        std::vector<unsigned long> key;     // Next use of each resident page
+
+        void swapNodes(int a, int b){
+            std::swap(heap[a], heap[b]);
+            position[heap[a]] = a;
+            position[heap[b]] = b;
+        }
+
+        void siftUp(int i){
+            while (i > 0 && key[heap[(i - 1)/2]] < key[heap[i]]){
+                swapNodes(i, (i - 1)/2);
+                i = (i - 1)/2;
             }
-            if (DEBUG){
-                char str[2];
-                fgets(str, 2, stdin);
+        }
+
+        void siftDown(int i){
+            while (true){
+                int largest = i, left = 2*i + 1, right = 2*i + 2;
+                if (left < (int)heap.size() && key[heap[left]] > key[heap[largest]]) largest = left;
+                if (right < (int)heap.size() && key[heap[right]] > key[heap[largest]]) largest = right;
+                if (largest == i) return;
+                swapNodes(i, largest);
+                i = largest;
             }
         }
+    public:
+        static const bool OFFLINE = true;
+        static const char* name(){ return "OPT"; }
 
-        int getSize(){
-            return pages.size();
+        void init(int numPages, int){
+            heap.clear();
+            position.assign(numPages, -1);
+            key.assign(numPages, NEVER);
         }
 
-        int getID(){
-            return id;
+        // Next use only moves later, so the page can only go up in the heap
+        void hit(int page, unsigned long next){
+            key[page] = next;
+            siftUp(position[page]);
+        }
+
+        void load(int page, unsigned long next){
+            key[page] = next;
+            position[page] = heap.size();
+            heap.push_back(page);
+            siftUp(position[page]);
+        }
+
+        int evict(int){
+            int page = heap[0];
+            swapNodes(0, heap.size() - 1);
+            heap.pop_back();
+            position[page] = -1;
+            if (!heap.empty()) siftDown(0);
+            return page;
+        }
+};
+
+// Intrusive doubly linked lists over page numbers, for the policies that move pages between several lists.
+// A page is on at most one list. The front is the most recent end.
+class PageLists{
+    private:
+        std::vector<int> prev, next;
+        std::vector<signed char> list;      // List each page is on, -1 for none
+        std::vector<int> heads, tails, sizes;
+    public:
+        void init(int numPages, int numLists){
+            prev.assign(numPages, -1);
+            next.assign(numPages, -1);
+            list.assign(numPages, -1);
+            heads.assign(numLists, -1);
+            tails.assign(numLists, -1);
+            sizes.assign(numLists, 0);
+        }
+
+        int which(int page){ return list[page]; }
+        int size(int l){ return sizes[l]; }
+        int back(int l){ return tails[l]; }     // Least recent page, -1 if the list is empty
+
+        void pushFront(int l, int page){
+            list[page] = l;
+            prev[page] = -1;
+            next[page] = heads[l];
+            if (heads[l] >= 0) prev[heads[l]] = page;
+            else tails[l] = page;
+            heads[l] = page;
+            ++sizes[l];
+        }
+
+        void remove(int page){
+            int l = list[page];
+            if (l < 0) return;
+            if (prev[page] >= 0) next[prev[page]] = next[page];
+            else heads[l] = next[page];
+            if (next[page] >= 0) prev[next[page]] = prev[page];
+            else tails[l] = prev[page];
+            list[page] = -1;
+            --sizes[l];
+        }
+
+        void moveFront(int l, int page){
+            remove(page);
+            pushFront(l, page);
+        }
+};
+
+// Adaptive Replacement Cache (Megiddo and Modha). T1 holds pages seen once recently, T2 pages seen at least twice.
+// B1 and B2 remember pages recently evicted from each. A hit in B1 means T1 was too small, a hit in B2 that T2 was,
+// and the target size p of T1 moves accordingly. A scan only passes through T1, so the pages in T2 survive it.
+// The ghost lists together hold at most as many pages as there are frames.
+class ARCPolicy{
+    private:
+        enum { T1, T2, B1, B2 };
+        PageLists lists;
+        int c;              // Frames
+        double p;           // Target size of T1
+        int pending;        // Page whose miss evict() already adapted to
+
+        int total(){
+            return lists.size(T1) + lists.size(T2) + lists.size(B1) + lists.size(B2);
         }
 
-        void setup(int space, string algo){
-            if (pages.size() < space) space = pages.size();
-            for (int i = 0; i < space; i++) {
-                pages[i][1] = 1;
-                MAINMEM.swapIn(pages[i][0], id, i);
-                if(algo == "FIFO") pages[i][2] = VCOUNT++;
-                else if(algo == "LRU") pages[i][2] = RCOUNT++;
-                else if(algo == "Clock") pages[i][2] = 1;
+        // Moves p towards the list the ghost hit says is too small
+        void adapt(int ghost){
+            if (ghost == B1) p = std::min<double>(c, p + std::max(1.0, double(lists.size(B2))/lists.size(B1)));
+            else if (ghost == B2) p = std::max(0.0, p - std::max(1.0, double(lists.size(B1))/lists.size(B2)));
+        }
+
+        // Evicts the least recent page of T1 or T2 into its ghost list
+        int replace(bool inB2){
+            int page;
+            if (lists.size(T1) >= 1 && ((inB2 && lists.size(T1) == p) || lists.size(T1) > p || lists.size(T2) == 0)){
+                page = lists.back(T1);
+                lists.moveFront(B1, page);
+            }else{
+                page = lists.back(T2);
+                lists.moveFront(B2, page);
             }
+            return page;
         }
+    public:
+        static const bool OFFLINE = false;
+        static const char* name(){ return "ARC"; }
 
-        bool checkMain(int localPage, string algo){
-            if(algo == "LRU") pages[localPage][2] = RCOUNT++;
-            if(localPage < pages.size() && pages[localPage][1]==1) return true;
-            else return false;
+        void init(int numPages, int frames){
+            lists.init(numPages, 4);
+            c = frames;
+            p = 0;
+            pending = -1;
         }
 
-        void FIFO(int localPage){
-            if(DEBUG) cout << "localPage: " << localPage << endl;
-            int oldestPage = -1;
-            // Find the oldest loaded page
-            for (int i = 0; i < pages.size(); i++){
-                // Set the inital oldestPage at the first valid bit it finds.
-                if(pages[i][1] == 1){
-                    if(oldestPage < 0){
-                        oldestPage = i;
-                    }else{
-                        if(pages[i][2] < pages[oldestPage][2]) oldestPage = i;
+        void hit(int page, unsigned long){
+            lists.moveFront(T2, page);
+        }
+
+        int evict(int incoming){
+            int ghost = incoming >= 0 ? lists.which(incoming) : -1;
+            adapt(ghost);
+            pending = incoming;
+            if (ghost != B1 && ghost != B2){
+                if (lists.size(T1) + lists.size(B1) >= c){
+                    if (lists.size(T1) < c) lists.remove(lists.back(B1));
+                    else {
+                        // T1 alone fills memory, its least recent page is dropped without a ghost
+                        int page = lists.back(T1);
+                        lists.remove(page);
+                        return page;
                     }
+                }else if (total() >= 2*c && lists.size(B2) > 0) lists.remove(lists.back(B2));
+            }
+            return replace(ghost == B2);
+        }
+
+        void load(int page, unsigned long){
+            int ghost = lists.which(page);
+            if (pending != page){
+                // Loaded into a free frame, so evict() never saw this miss
+                adapt(ghost);
+                if (ghost != B1 && ghost != B2){
+                    if (lists.size(T1) + lists.size(B1) >= c && lists.size(B1) > 0) lists.remove(lists.back(B1));
+                    else if (total() >= 2*c && lists.size(B2) > 0) lists.remove(lists.back(B2));
                 }
             }
-            // Unload the old page and load the new
-            pages[oldestPage][1] = 0;
-            pages[localPage][1] = 1;
-            pages[localPage][2] = VCOUNT++;
-            MAINMEM.swapIn(pages[localPage][0], id, MAINMEM.findPhysical(pages[oldestPage][0])-(PROGSIZE*id));
-        }
-
-        void LRU(int localPage){
-            if(DEBUG) cout << "localPage: " << localPage << endl;
-            int oldestPage = -1;
-            // Find the oldest loaded page
-            for (int i = 1; i < pages.size(); i++){
-                if(pages[i][1] == 1){
-                    if(oldestPage < 0){
-                        oldestPage = i;
-                    }else{
-                        if(pages[i][2] < pages[oldestPage][2]) oldestPage = i;
+            pending = -1;
+            if (ghost == B1 || ghost == B2) lists.moveFront(T2, page);
+            else lists.pushFront(T1, page);
+        }
+};
+
+// Clock with Adaptive Replacement (Bansal and Modha). ARC's lists, but T1 and T2 are clocks with reference bits,
+// so a hit only sets a bit. The back of a clock list is its hand, and pages passed over with their bit set go to the front of T2.
+class CARPolicy{
+    private:
+        enum { T1, T2, B1, B2 };
+        PageLists lists;
+        std::vector<unsigned char> referenced;
+        int c;              // Frames
+        double p;           // Target size of T1
+
+        int total(){
+            return lists.size(T1) + lists.size(T2) + lists.size(B1) + lists.size(B2);
+        }
+    public:
+        static const bool OFFLINE = false;
+        static const char* name(){ return "CAR"; }
+
+        void init(int numPages, int frames){
+            lists.init(numPages, 4);
+            referenced.assign(numPages, 0);
+            c = frames;
+            p = 0;
+        }
+
+        void hit(int page, unsigned long){
+            referenced[page] = 1;
+        }
+
+        int evict(int){
+            while (true){
+                if (lists.size(T1) >= std::max(1.0, p) || lists.size(T2) == 0){
+                    int page = lists.back(T1);
+                    if (!referenced[page]){
+                        lists.moveFront(B1, page);
+                        return page;
                     }
+                    referenced[page] = 0;
+                    lists.moveFront(T2, page);
+                }else{
+                    int page = lists.back(T2);
+                    if (!referenced[page]){
+                        lists.moveFront(B2, page);
+                        return page;
+                    }
+                    referenced[page] = 0;
+                    lists.moveFront(T2, page);
                 }
             }
-            // Unload the old page and load the new
-            pages[oldestPage][1] = 0;
-            pages[localPage][1] = 1;
-            MAINMEM.swapIn(pages[localPage][0], id, MAINMEM.findPhysical(pages[oldestPage][0])-(PROGSIZE*id));
         }
 
-        void clock(int localPage){
-            bool replaced = false;
-            while(!replaced){
-                if(!DEBUG) cout << "Hand: " << hand << endl;
-                if(pages[hand][1] == 1){
-                    if(pages[hand][2] == 1){
-                        pages[hand][2] == 0;
+        void load(int page, unsigned long){
+            int ghost = lists.which(page);
+            referenced[page] = 0;
+            if (ghost == B1){
+                p = std::min<double>(c, p + std::max(1.0, double(lists.size(B2))/lists.size(B1)));
+                lists.moveFront(T2, page);
+            }else if (ghost == B2){
+                p = std::max(0.0, p - std::max(1.0, double(lists.size(B1))/lists.size(B2)));
+                lists.moveFront(T2, page);
+            }else{
+                // Keep the ghost lists within the number of frames
+                if (lists.size(T1) + lists.size(B1) >= c && lists.size(B1) > 0) lists.remove(lists.back(B1));
+                else if (total() >= 2*c && lists.size(B2) > 0) lists.remove(lists.back(B2));
+                lists.pushFront(T1, page);
+            }
+        }
+};
+
+// Full 2Q (Johnson and Shasha). New pages go to the FIFO A1in. Pages evicted from A1in are remembered in the ghost FIFO A1out,
+// and only a page referenced again while in A1out gets into the LRU list Am. Scanned pages never get past A1in.
+// A1in is kept to a quarter of the frames and A1out to half.
+class TwoQPolicy{
+    private:
+        enum { AIN, AOUT, AM };
+        PageLists lists;
+        int kin, kout;      // Size limits of A1in and A1out
+        int promoted;       // Page found in A1out by evict(), already taken off it
+    public:
+        static const bool OFFLINE = false;
+        static const char* name(){ return "2Q"; }
+
+        void init(int numPages, int frames){
+            lists.init(numPages, 3);
+            kin = std::max(1, frames/4);
+            kout = std::max(1, frames/2);
+            promoted = -1;
+        }
+
+        void hit(int page, unsigned long){
+            if (lists.which(page) == AM) lists.moveFront(AM, page);
+        }
+
+        int evict(int incoming){
+            // Take the incoming page off A1out first so trimming A1out can't forget it
+            if (incoming >= 0 && lists.which(incoming) == AOUT){
+                lists.remove(incoming);
+                promoted = incoming;
+            }
+            int page;
+            if (lists.size(AIN) > kin || lists.size(AM) == 0){
+                page = lists.back(AIN);
+                lists.moveFront(AOUT, page);
+                if (lists.size(AOUT) > kout) lists.remove(lists.back(AOUT));
+            }else{
+                page = lists.back(AM);
+                lists.remove(page);
+            }
+            return page;
+        }
+
+        void load(int page, unsigned long){
+            if (page == promoted || lists.which(page) == AOUT) lists.moveFront(AM, page);
+            else lists.pushFront(AIN, page);
+            promoted = -1;
+        }
+};
+
+// CLOCK-Pro (Jiang, Chen and Zhang). Pages are hot or cold, and cold pages get a test period after being loaded.
+// A cold page referenced again during its test period turns hot. Evicted cold pages still in their test period stay on the clock
+// without a frame, and a fault on one of them means cold pages need more room, so the cold target mc grows.
+// A test period running out without a reference shrinks it. Three hands go round one circular list:
+//   handCold  finds a cold resident page to evict
+//   handHot   turns a hot page cold when there are too many hot pages, ending test periods it passes
+//   handTest  ends test periods when more than frames pages are kept without a frame
+class ClockProPolicy{
+    private:
+        enum { NONE, HOT, COLD };
+        std::vector<int> prev, next;            // Circular list
+        std::vector<unsigned char> state, resident, test, referenced;
+        int handHot, handCold, handTest;
+        int c;                                  // Frames
+        int mc;                                 // Target number of cold resident pages
+        int hotCount, coldCount, ghostCount;    // Hot pages, cold resident pages, and cold pages without a frame
+
+        // Inserts a page at the head of the list, which is just behind handHot
+        void insert(int page){
+            if (handHot < 0){
+                prev[page] = next[page] = page;
+                handHot = handCold = handTest = page;
+                return;
+            }
+            int before = prev[handHot];
+            next[before] = page;
+            prev[page] = before;
+            next[page] = handHot;
+            prev[handHot] = page;
+        }
+
+        void unlink(int page){
+            int after = next[page] == page ? -1 : next[page];
+            if (handHot == page) handHot = after;
+            if (handCold == page) handCold = after;
+            if (handTest == page) handTest = after;
+            if (after >= 0){
+                next[prev[page]] = next[page];
+                prev[next[page]] = prev[page];
+            }
+        }
+
+        // Ends the test period of a cold page. Without a frame it leaves the clock and mc shrinks.
+        void endTest(int page){
+            test[page] = 0;
+            if (!resident[page]){
+                unlink(page);
+                state[page] = NONE;
+                --ghostCount;
+                mc = std::max(1, mc - 1);
+            }
+        }
+
+        // Moves handHot round until one hot page has been turned cold
+        void runHandHot(){
+            while (hotCount > 0){
+                int page = handHot;
+                handHot = next[page];
+                if (state[page] == HOT){
+                    if (referenced[page]) referenced[page] = 0;
+                    else {
+                        state[page] = COLD;
+                        --hotCount;
+                        ++coldCount;
+                        return;
+                    }
+                }else if (test[page]) endTest(page);
+            }
+        }
+
+        // Moves handTest round until one cold page without a frame has left the clock
+        void runHandTest(){
+            while (ghostCount > c){
+                int page = handTest;
+                handTest = next[page];
+                if (state[page] == COLD && test[page]) endTest(page);
+            }
+        }
+    public:
+        static const bool OFFLINE = false;
+        static const char* name(){ return "CLOCK-Pro"; }
+
+        void init(int numPages, int frames){
+            prev.assign(numPages, -1);
+            next.assign(numPages, -1);
+            state.assign(numPages, NONE);
+            resident.assign(numPages, 0);
+            test.assign(numPages, 0);
+            referenced.assign(numPages, 0);
+            handHot = handCold = handTest = -1;
+            c = frames;
+            mc = std::max(1, frames/2);
+            hotCount = coldCount = ghostCount = 0;
+        }
+
+        void hit(int page, unsigned long){
+            referenced[page] = 1;
+        }
+
+        int evict(int){
+            while (true){
+                if (coldCount == 0) runHandHot();
+                int page = handCold;
+                handCold = next[page];
+                if (state[page] != COLD || !resident[page]) continue;
+                if (referenced[page]){
+                    referenced[page] = 0;
+                    if (test[page]){
+                        // Referenced during its test period: the page turns hot
+                        state[page] = HOT;
+                        test[page] = 0;
+                        ++hotCount;
+                        --coldCount;
+                        if (hotCount > c - mc) runHandHot();
                     }else{
-                        pages[hand][1] = 0;
-                        pages[localPage][2] = 1;
-                        pages[localPage][1] = 1;
-                        MAINMEM.swapIn(pages[localPage][0], id, MAINMEM.findPhysical(pages[hand][0])-(PROGSIZE*id));
-                        replaced = true;
+                        // Give it a new test period from the head of the list
+                        test[page] = 1;
+                        unlink(page);
+                        insert(page);
                     }
+                }else{
+                    resident[page] = 0;
+                    --coldCount;
+                    if (test[page]){
+                        ++ghostCount;
+                        runHandTest();
+                    }else{
+                        unlink(page);
+                        state[page] = NONE;
+                    }
+                    return page;
                 }
-                hand = (hand+1) % pages.size();
             }
         }
-        
-        // you can split this up into three different functions if you want
-        void pageSwap(int localPage, string algo, string pagingMethod){
-            if (!checkMain(localPage, algo)){
-                if (algo == "FIFO") FIFO(localPage);
-                else if (algo == "LRU") LRU(localPage);
-                else if (algo == "Clock") clock(localPage);
-                if (pagingMethod == "+") pageSwap((localPage + 1) % pages.size(), algo, "-");
-            } else pageSwap((localPage + 1) % pages.size(), algo, pagingMethod);
+
+        void load(int page, unsigned long){
+            referenced[page] = 0;
+            resident[page] = 1;
+            if (state[page] == COLD){
+                // Faulted on during its test period: cold pages need more room, and this one turns hot
+                mc = std::min(c, mc + 1);
+                --ghostCount;
+                test[page] = 0;
+                unlink(page);
+                state[page] = HOT;
+                ++hotCount;
+                insert(page);
+                if (hotCount > c - mc) runHandHot();
+            }else{
+                state[page] = COLD;
+                test[page] = 1;
+                ++coldCount;
+                insert(page);
+            }
         }
 };
 
-int main(int argc, char* argv[]){
-    // Ensuring the correct amount of parameters
-    if (argc != 6) {
-        std::cout << "Usage ./assign2 plist ptrace P1 P2 P3\n"
-                  << "P1: Size of pages/# of memory locations per page\n"
-                  << "P2: Type of page replacement algo (FIFO, LRU, or Clock)\n"
-                  << "P3: Turn on or off pre-paging ('+' for on, '-' for off)" << std::endl;
-        return -1;
-    }
+// Page table for each program, where each vector index is a local page.
+// Each entry holds the page number (unique among all pages in all tables) and the frame holding the page, -1 if it's not in memory.
+// For offline policies it also holds the position of the page's next reference.
+// Prepaging is a template parameter like the policy: when on, a fault also brings in pages the Prefetcher expects to be used next.
+struct PageEntry{
+    unsigned long number;
+    int frame;
+    unsigned long nextUse;
+    bool prefetched;        // Brought in by pre-paging and not referenced since
+};
 
-    // Input values
-    string plist = argv[1];      // Plist file
-    string ptrace = argv[2];     // Ptrace file
-    SOP = atoi(argv[3]);     // Size of pages
-    string algo = argv[4];       // Algorithm: FIFO, LRU, or Clock
-    string pre_paging = argv[5]; // Pre-paging: + for on, - for off
-
-    // Setting up first ifstream as well as vector to hold the page tables
-    std::ifstream i(plist + ".txt");
-    std::string in;
-    int program_id, total_pages;
-    std::vector<PageTable> programs;
-    MAINMEM.initPhysicalMemory();
-
-    // Opening plist and setting up the page tables
-    if (i.is_open()){
-        int chk;
-        while (getline(i, in)){
-            std::stringstream ss(in);
-            chk = 0;
-            while (getline(ss, in, ' ')){
-                if (chk == 0){
-                    program_id = std::stoi(in);
-                    ++chk;
-                }
-                else{
-                    if (DEBUG) std::cout << float(stoi(in))/float(SOP) << std::endl;
-                    total_pages = ceil(float(stoi(in))/float(SOP));
+// Pre-paging counts: pages brought in ahead of use, and how many of them were referenced before or after being evicted
+struct PrefetchStats{
+    unsigned long issued = 0;
+    unsigned long useful = 0;
+    unsigned long wasted = 0;
+};
+
+// Counts for one program at the end of a run
+struct ProcessStats{
+    int id;
+    unsigned long references;
+    unsigned long hits;
+    unsigned long faults;
+    unsigned long evictions;    // Pages of this program pushed out of memory
+    int frames;                 // Frames it holds
+    PrefetchStats prefetches;
+};
+
+// Adaptive pre-paging for one program. It watches the stride between the program's references: while the same stride
+// keeps repeating, the number of pages brought in on a fault doubles up to PREFETCH_DEPTH, and when it breaks the
+// window halves, down to nothing for random access. Pages are fetched along the stride, or sequentially until one is seen.
+class Prefetcher{
+    private:
+        int lastPage;       // Last page referenced, -1 before the first reference
+        int stride;         // Last distance between two different pages referenced
+        int streak;         // Times in a row the stride has repeated
+        int window;         // Pages to bring in on the next fault
+    public:
+        Prefetcher() : lastPage(-1), stride(1), streak(0), window(1){}
+
+        void observe(int page){
+            if (lastPage >= 0 && page != lastPage){
+                int delta = page - lastPage;
+                if (delta == stride) ++streak;
+                else {
+                    stride = delta;
+                    streak = 0;
                 }
             }
-            if (DEBUG) std::cout << program_id << " " << total_pages << std::endl;
-            programs.push_back(PageTable(program_id, total_pages));
-        }
-    }
-    i.close();
-    // Default loading of memory
-    // Dividing the total memory by size of pages to get how many pages can fit in memory. 
-    // Divide that by number of programs to find how many pages each program is allocated.
-    // As a check, SOP = 2 -> page per program = 25, SOP = 4 -> page per program = 12, SOP = 8 -> page per program = 6, etc.
-    PROGSIZE = (MEMSIZE/SOP)/programs.size();
-    for (int i = 0; i < programs.size(); i++){
-        programs[i].setup(PROGSIZE, algo);
-    }
-    
-    int memory_ref, line=0;
-    ifstream i2(ptrace + ".txt");
-    if (i2.is_open()){ 
-        int chk;
-        while (getline(i2, in)){
-            if(!DEBUG) cout << "Line: " << line++ << endl;
-            std::stringstream ss(in);
-            chk = 0;
-            while (getline(ss, in, ' ')){
-                if (chk == 0){
-                    program_id = stoi(in);
-                    ++chk;
-                }
-                else{
-                    if (DEBUG) cout << program_id << " " << stoi(in) << endl;
-                    memory_ref = float(stoi(in))/float(SOP);
-                }
+            lastPage = page;
+        }
+
+        // Adjusts the window on a fault and returns how many pages to bring in, at most limit
+        int onFault(int limit){
+            if (streak > 0) window = std::max(1, std::min(2*window, PREFETCH_DEPTH));
+            else window /= 2;
+            return std::min(window, limit);
+        }
+
+        int getStride(){
+            return streak > 0 ? stride : 1;
+        }
+};
+
+// Working set of one program: the distinct pages among its last WS_WINDOW references, kept up to date on every reference
+class WorkingSet{
+    private:
+        std::vector<unsigned long> lastUse;     // Program time of each page's last reference, 0 for never
+        std::vector<int> recent;                // The last window pages referenced, as a ring buffer
+        unsigned long time;
+        int size;
+    public:
+        WorkingSet() : time(0), size(0){}
+
+        void init(int numPages, int window){
+            lastUse.assign(numPages, 0);
+            recent.assign(std::max(1, window), 0);
+        }
+
+        void observe(int page){
+            ++time;
+            size_t slot = time % recent.size();
+            if (time > recent.size()){
+                // The reference leaving the window takes its page out of the set if the page wasn't referenced since
+                unsigned long leaving = time - recent.size();
+                if (lastUse[recent[slot]] == leaving) --size;
+            }
+            if (lastUse[page] == 0 || lastUse[page] + recent.size() <= time) ++size;
+            lastUse[page] = time;
+            recent[slot] = page;
+        }
+
+        int getSize(){
+            return size;
+        }
+};
+
+template<class Policy, bool Prepaging> class SimulationOf;
+
+template<class Policy, bool Prepaging>
+class PageTable{
+    friend class SimulationOf<Policy, Prepaging>;   // Does the swapping, which may move frames between page tables
+    private:
+        int id;                 // Process ID
+        int resident;           // Pages currently in memory
+        int target;             // Frames the program is entitled to under page fault frequency allocation
+        bool swappedOut;        // Held to MIN_FRAMES by working-set load control until its working set fits again
+        unsigned long time;     // References made by this program
+        unsigned long faults;
+        unsigned long evictions;
+        unsigned long lastFault;
+        unsigned long now;      // Position in the trace of the reference being simulated, kept for offline policies
+        int levels;             // Levels of the page table walked on a TLB miss
+        SimState* sim;          // Simulation this page table belongs to
+        std::vector<PageEntry> pages;
+        Policy* policy;         // The program's own policy, or the one shared by every program under global allocation
+        int keyBase;            // Added to a local page to get its number in the policy
+        Prefetcher prefetcher;
+        PrefetchStats prefetches;
+        WorkingSet workingSet;
+
+        // Position of the next reference to the page. A page referenced right now moves on to its following reference.
+        inline unsigned long upcoming(int localPage, bool referenced){
+            if (!Policy::OFFLINE) return 0;
+            if (referenced) pages[localPage].nextUse = sim->future->next[now];
+            return pages[localPage].nextUse;
+        }
+
+        // Puts a page in the given frame. referenced is false for pages loaded ahead of being used (setup and pre-paging).
+        void install(int localPage, int frame, bool referenced){
+            pages[localPage].frame = frame;
+            ++resident;
+            policy->load(keyBase + localPage, upcoming(localPage, referenced));
+        }
+
+        // Takes an evicted page out of memory and returns the frame it was in
+        int release(int localPage){
+            if (DEBUG) cout << "Evicting: " << localPage << " of " << id << endl;
+            if (Prepaging && pages[localPage].prefetched){
+                ++prefetches.wasted;
+                pages[localPage].prefetched = false;
             }
-            if (!programs[program_id].checkMain(memory_ref, algo)){
-                // If the given memory doesn't have space to pre-page don't.
-                if(memory_ref >= programs[program_id].getSize()-1) programs[program_id].pageSwap(memory_ref, algo, "-");
-                else programs[program_id].pageSwap(memory_ref, algo, pre_paging);
-                ++PSCOUNT;
-                if(DEBUG) programs[program_id].print();
-                if(!DEBUG) cout << "Page Swaps: " << PSCOUNT << endl;
+            if (sim->tlb.enabled()) sim->tlb.invalidate(pages[localPage].number);
+            int frame = pages[localPage].frame;
+            pages[localPage].frame = -1;
+            --resident;
+            ++evictions;
+            return frame;
+        }
+
+        // Frames the program should hold, under the allocations where that changes as it runs
+        int share(){
+            if (sim->ALLOC == WORKING_SET) return swappedOut ? MIN_FRAMES : std::max(MIN_FRAMES, workingSet.getSize());
+            return target;
+        }
+
+        // Page fault frequency: adjusts the program's share by the number of its references since its last fault
+        void faulted(int frames){
+            unsigned long gap = time - lastFault;
+            lastFault = time;
+            if (gap < (unsigned long)PFF_LOW) target = std::min(frames, target + 1);
+            else if (gap > (unsigned long)PFF_HIGH) target = std::max(std::min(frames, MIN_FRAMES), target - 1);
+        }
+    public:
+        PageTable(int id, int numPages, SimState* sim) : id(id), resident(0), target(0), swappedOut(false), time(0), faults(0), evictions(0), lastFault(0), now(0), sim(sim), policy(NULL), keyBase(0){
+            pages.resize(numPages);
+            for (int i = 0; i < numPages; i++){
+                pages[i].number = sim->PCOUNT++;
+                pages[i].frame = -1;
+                pages[i].nextUse = NEVER;
+                pages[i].prefetched = false;
+                if (Policy::OFFLINE && (size_t)id < sim->future->first.size() && (size_t)i < sim->future->first[id].size()) pages[i].nextUse = sim->future->first[id][i];
             }
+            if (sim->ALLOC == WORKING_SET) workingSet.init(numPages, WS_WINDOW);
+            // Enough levels of WALK_BITS each to cover every page number
+            int bits = 0;
+            while (bits < 63 && (1UL << bits) < (unsigned long)numPages) ++bits;
+            levels = std::max(1, (bits + WALK_BITS - 1)/WALK_BITS);
         }
-    }
 
-    // Copy and paste this to print page table to check values at a certain point (It'll be really long if size of page is small)
-    if (DEBUG) {
-        for (int i = 0; i < programs.size(); i++){
-            programs[i].print();
+        // Use to check the page tables at a certain point
+        void print(){
+            std::cout << "Process ID: " << id << " Frames: " << resident << std::endl;
+            for (size_t i = 0; i < pages.size(); i++){
+                std::cout << pages[i].number << " " << pages[i].frame << std::endl;
+            }
         }
+
+        int getSize(){
+            return pages.size();
+        }
+
+        int getID(){
+            return id;
+        }
+
+        int getResident(){
+            return resident;
+        }
+
+        PrefetchStats getPrefetches(){
+            return prefetches;
+        }
+
+        ProcessStats getStats(){
+            ProcessStats stats = {id, time, time - faults, faults, evictions, resident, prefetches};
+            return stats;
+        }
+
+        // Checks if the page is in memory, and lets the policy know it was referenced if so
+        bool checkMain(int localPage){
+            ++time;
+            if (sim->ALLOC == WORKING_SET) workingSet.observe(localPage);
+            if (Prepaging) prefetcher.observe(localPage);
+            if (pages[localPage].frame >= 0){
+                policy->hit(keyBase + localPage, upcoming(localPage, true));
+                if (Prepaging && pages[localPage].prefetched){
+                    ++prefetches.useful;
+                    pages[localPage].prefetched = false;
+                }
+                return true;
+            }
+            return false;
+        }
+};
+
+// One run of the simulator: a page size, an algorithm and a pre-paging setting applied to every program.
+// The algorithm and pre-paging setting are picked once by makeSimulation, everything below that is a SimulationOf specialization.
+class Simulation{
+    public:
+        virtual ~Simulation(){}
+
+        // Simulates one reference. Returns true if it caused a page fault.
+        virtual bool reference(const Reference& ref) = 0;
+
+        // Simulates a whole buffer of references
+        virtual void run(const Reference* refs, size_t count) = 0;
+
+        // Same as run, with the programs shared out among threads and their faults added up at the end.
+        // Only local allocation keeps the programs independent of each other, the others run on this thread.
+        virtual void runParallel(const Reference* refs, size_t count, int threads) = 0;
+
+        virtual unsigned long faults() = 0;
+
+        // Pre-paging counts summed over every program
+        virtual PrefetchStats prefetches() = 0;
+
+        // TLB counts, all 0 unless TLB_ENTRIES is set
+        virtual TranslationStats translation() = 0;
+
+        // Counts for each program, in plist order
+        virtual std::vector<ProcessStats> processStats() = 0;
+
+        virtual void print() = 0;
+};
+
+template<class Policy, bool Prepaging>
+class SimulationOf : public Simulation{
+    private:
+        SimState state;
+        NextUse future;
+        std::vector<PageTable<Policy, Prepaging>> programs;
+        std::vector<Policy> policies;   // One per program, or a single one under global allocation
+        std::vector<int> pageOwner;     // Program each page number belongs to, only under global allocation
+
+        // Program that gives up a frame when the given one faults with memory full.
+        // Under local allocation it's always the faulting program. Under working-set and page fault frequency allocation
+        // it's the program holding the most frames beyond its share, the faulting program itself on a tie. Other programs
+        // are never taken below MIN_FRAMES, unless the faulting one has no frame of its own to give up.
+        int victimFor(int index){
+            if (state.ALLOC == LOCAL) return index;
+            int victim = index;
+            long excess = programs[index].resident > 0 ? long(programs[index].resident) - programs[index].share() : LONG_MIN;
+            for (size_t i = 0; i < programs.size(); i++){
+                if (programs[i].resident <= MIN_FRAMES) continue;
+                long over = long(programs[i].resident) - programs[i].share();
+                if (over > excess){
+                    victim = i;
+                    excess = over;
+                }
+            }
+            if (excess > LONG_MIN) return victim;
+            for (size_t i = 0; i < programs.size(); i++){
+                if (programs[i].resident > programs[victim].resident) victim = i;
+            }
+            return victim;
+        }
+
+        // Working-set load control. While the shares add up to more frames than there are, the program with the largest
+        // working set is swapped out, leaving it MIN_FRAMES, so the others keep their working sets instead of every program
+        // being stripped down. One program always stays in. A swapped out program comes back in once its working set fits.
+        void loadControl(){
+            long frames = state.MAINMEM.size(), demand = 0;
+            int in = 0;
+            for (size_t i = 0; i < programs.size(); i++){
+                demand += programs[i].share();
+                if (!programs[i].swappedOut) ++in;
+            }
+            while (demand > frames && in > 1){
+                int out = -1;
+                for (size_t i = 0; i < programs.size(); i++){
+                    if (programs[i].swappedOut) continue;
+                    if (out < 0 || programs[i].share() > programs[out].share()) out = i;
+                }
+                demand -= programs[out].share() - MIN_FRAMES;
+                programs[out].swappedOut = true;
+                --in;
+            }
+            for (size_t i = 0; i < programs.size(); i++){
+                if (!programs[i].swappedOut) continue;
+                long size = std::max(MIN_FRAMES, programs[i].workingSet.getSize());
+                if (demand - MIN_FRAMES + size > frames) continue;
+                demand += size - MIN_FRAMES;
+                programs[i].swappedOut = false;
+            }
+        }
+
+        // Brings a page of the program at index into memory. It gets a free frame if the program is allowed one,
+        // otherwise a page is evicted, and the frame is handed over to this program.
+        void swapIn(int index, int localPage, bool referenced){
+            PageTable<Policy, Prepaging>& program = programs[index];
+            int frame;
+            if (state.MAINMEM.hasFree() && (state.ALLOC != LOCAL || program.resident < state.PROGSIZE)){
+                frame = state.MAINMEM.allocate();
+            }else if (state.ALLOC == GLOBAL){
+                int victim = policies[0].evict(program.keyBase + localPage);
+                PageTable<Policy, Prepaging>& owner = programs[pageOwner[victim]];
+                frame = owner.release(victim - owner.keyBase);
+            }else{
+                PageTable<Policy, Prepaging>& owner = programs[victimFor(index)];
+                int victim = owner.policy->evict(&owner == &program ? localPage : -1);
+                frame = owner.release(victim);
+            }
+            state.MAINMEM.swapIn(program.pages[localPage].number, frame, index);
+            program.install(localPage, frame, referenced);
+        }
+
+        // Frames the program at index may fill, which also bounds how far pre-paging reaches
+        int capacity(int index){
+            if (state.ALLOC == LOCAL) return state.PROGSIZE;
+            if (state.ALLOC == GLOBAL) return state.MAINMEM.size();
+            return programs[index].share();
+        }
+
+        // Handles a fault on the given page
+        void pageSwap(int index, int localPage){
+            PageTable<Policy, Prepaging>& program = programs[index];
+            ++program.faults;
+            if (state.MAINMEM.size() == 0) return;      // No frames, nothing can be loaded
+            if (state.ALLOC == FAULT_FREQUENCY) program.faulted(state.MAINMEM.size());
+            if (state.ALLOC == WORKING_SET) loadControl();
+            int limit = capacity(index);
+            if (limit == 0) return;
+            swapIn(index, localPage, true);
+            if (Prepaging){
+                // Never bring in so many pages that the one just loaded could be pushed out
+                int count = program.prefetcher.onFault(limit - 1);
+                int stride = program.prefetcher.getStride();
+                int next = localPage;
+                for (int i = 0; i < count; i++){
+                    next += stride;
+                    if (next < 0 || next >= (int)program.pages.size()) break;
+                    if (program.pages[next].frame >= 0) continue;
+                    swapIn(index, next, false);
+                    program.pages[next].prefetched = true;
+                    ++program.prefetches.issued;
+                }
+            }
+        }
+
+        // On a TLB miss the page table is walked, and the translation is cached if the page ended up in memory
+        void walk(PageTable<Policy, Prepaging>& program, int localPage){
+            ++state.tlb.stats.walks;
+            state.tlb.stats.levels += program.levels;
+            if (program.pages[localPage].frame >= 0) state.tlb.insert(program.pages[localPage].number);
+        }
+
+        inline bool step(const Reference& ref){
+            PageTable<Policy, Prepaging>& program = programs[ref.pid];
+            int memory_ref = ref.address/state.SOP;
+            if (Policy::OFFLINE) program.now = state.RCOUNT;
+            bool cached = state.tlb.enabled() && state.tlb.lookup(program.pages[memory_ref].number);
+            bool fault = !program.checkMain(memory_ref);
+            if (fault){
+                pageSwap(ref.pid, memory_ref);
+                ++state.PSCOUNT;
+            }
+            if (state.tlb.enabled() && !cached) walk(program, memory_ref);
+            ++state.RCOUNT;
+            return fault;
+        }
+
+        // A thread of runParallel and the slot of programs it simulates
+        struct ParallelWorker{
+            SimulationOf* sim;
+            int slot;
+            pthread_t thread;
+        };
+
+        // The threads of runParallel. They're started by its first call and kept until the simulation is deleted, waiting at
+        // a barrier between chunks. The calling thread simulates slot 0, the workers slots 1 and up.
+        struct ParallelRun{
+            const Reference* refs;                  // The chunk being simulated
+            size_t count;
+            std::vector<int> slot;                  // Slot each program is simulated in
+            std::vector<unsigned long> references;  // References to each program in the chunk, which the next one is shared out by
+            std::vector<ParallelWorker> workers;
+            pthread_barrier_t start, done;          // Every slot meets at start before a chunk and at done after it
+            bool stop;                              // Set before start to have the workers exit instead
+        };
+        ParallelRun parallel;
+
+        // Simulates the chunk's references to the programs in one slot, scanning the chunk in place so it is never split up.
+        // Under local allocation this touches nothing another slot's programs use.
+        void runSlot(int slot){
+            const Reference* refs = parallel.refs;
+            for (size_t i = 0; i < parallel.count; i++){
+                int index = refs[i].pid;
+                if (parallel.slot[index] != slot) continue;
+                PageTable<Policy, Prepaging>& program = programs[index];
+                int memory_ref = refs[i].address/state.SOP;
+                if (Policy::OFFLINE) program.now = state.RCOUNT + i;
+                if (!program.checkMain(memory_ref)) pageSwap(index, memory_ref);
+            }
+        }
+
+        static void* parallelWorker(void* arg){
+            ParallelWorker* worker = (ParallelWorker*)arg;
+            ParallelRun& run = worker->sim->parallel;
+            while (true){
+                pthread_barrier_wait(&run.start);
+                if (run.stop) return NULL;
+                worker->sim->runSlot(worker->slot);
+                pthread_barrier_wait(&run.done);
+            }
+        }
+
+        // Starts the workers for the given number of slots, stopping any started for a different number. Returns false if
+        // they were already running.
+        bool startWorkers(int slots){
+            if (parallel.workers.size() == (size_t)slots - 1) return false;
+            stopWorkers();
+            parallel.stop = false;
+            pthread_barrier_init(&parallel.start, NULL, slots);
+            pthread_barrier_init(&parallel.done, NULL, slots);
+            // Sized before any thread starts, since each one keeps a pointer to its entry
+            parallel.workers.resize(slots - 1);
+            for (int i = 0; i < slots - 1; i++){
+                parallel.workers[i].sim = this;
+                parallel.workers[i].slot = i + 1;
+                pthread_create(&parallel.workers[i].thread, NULL, parallelWorker, &parallel.workers[i]);
+            }
+            parallel.slot.resize(programs.size());
+            return true;
+        }
+
+        void stopWorkers(){
+            if (parallel.workers.empty()) return;
+            parallel.stop = true;
+            pthread_barrier_wait(&parallel.start);
+            for (size_t i = 0; i < parallel.workers.size(); i++) pthread_join(parallel.workers[i].thread, NULL);
+            parallel.workers.clear();
+            pthread_barrier_destroy(&parallel.start);
+            pthread_barrier_destroy(&parallel.done);
+        }
+
+        // Shares the programs out among the slots by parallel.references. The busiest go first, each to the slot with the
+        // fewest references so far.
+        void balanceSlots(int slots){
+            std::vector<unsigned long>& references = parallel.references;
+            std::vector<int> order(programs.size());
+            for (size_t i = 0; i < programs.size(); i++) order[i] = i;
+            std::stable_sort(order.begin(), order.end(), [&references](int a, int b){
+                return references[a] > references[b];
+            });
+            std::vector<unsigned long> load(slots, 0);
+            for (size_t i = 0; i < order.size(); i++){
+                int slot = std::min_element(load.begin(), load.end()) - load.begin();
+                parallel.slot[order[i]] = slot;
+                load[slot] += references[order[i]];
+            }
+        }
+    public:
+        // Offline policies need the whole trace, which they must then be run over from the start
+        SimulationOf(const std::vector<Process>& processes, int SOP, const std::vector<Reference>* trace){
+            state.SOP = SOP;
+            state.ALLOC = ALLOCATION;
+            if (Policy::OFFLINE){
+                future.build(processes, *trace, SOP);
+                state.future = &future;
+            }
+            int total_pages;
+            for (size_t i = 0; i < processes.size(); i++){
+                total_pages = (processes[i].size + SOP - 1)/SOP;
+                if (DEBUG) std::cout << processes[i].id << " " << total_pages << std::endl;
+                programs.push_back(PageTable<Policy, Prepaging>(processes[i].id, total_pages, &state));
+            }
+            // Default loading of memory
+            // Dividing the total memory by size of pages to get how many pages can fit in memory. 
+            // Divide that by number of programs to find how many pages each program is allocated.
+            // As a check, SOP = 2 -> page per program = 25, SOP = 4 -> page per program = 12, SOP = 8 -> page per program = 6, etc.
+            // Under local allocation that share is fixed, the others start from it and move frames around as the programs run.
+            state.PROGSIZE = programs.size() > 0 ? (MEMSIZE/SOP)/programs.size() : 0;
+            state.MAINMEM.initPhysicalMemory(SOP);
+            state.tlb.init(TLB_ENTRIES, TLB_WAYS);
+            int frames = state.MAINMEM.size();
+            if (state.ALLOC == GLOBAL){
+                policies.resize(1);
+                policies[0].init(state.PCOUNT, frames);
+                for (size_t i = 0; i < programs.size(); i++) pageOwner.insert(pageOwner.end(), programs[i].getSize(), i);
+            }else{
+                policies.resize(programs.size());
+                for (size_t i = 0; i < programs.size(); i++) policies[i].init(programs[i].getSize(), state.ALLOC == LOCAL ? state.PROGSIZE : frames);
+            }
+            for (size_t i = 0; i < programs.size(); i++){
+                PageTable<Policy, Prepaging>& program = programs[i];
+                program.policy = &policies[state.ALLOC == GLOBAL ? 0 : i];
+                program.keyBase = state.ALLOC == GLOBAL && program.getSize() > 0 ? program.pages[0].number : 0;
+                program.target = std::max(1, state.PROGSIZE);
+                int space = std::min(state.PROGSIZE, program.getSize());
+                for (int j = 0; j < space; j++) swapIn(i, j, false);
+            }
+        }
+
+        ~SimulationOf(){
+            stopWorkers();
+        }
+
+        bool reference(const Reference& ref){
+            if (DEBUG) cout << ref.pid << " " << ref.address << endl;
+            bool fault = step(ref);
+            if (DEBUG && fault) programs[ref.pid].print();
+            return fault;
+        }
+
+        void run(const Reference* refs, size_t count){
+            for (size_t i = 0; i < count; i++) step(refs[i]);
+        }
+
+        // Under local allocation a program that still has fewer frames than its share and fewer than its pages would take a
+        // free frame on its next fault. That's the only way a run changes the frame table outside the faulting program's own
+        // frames, so the threads are only used once no program can.
+        bool framesSettled(){
+            for (size_t i = 0; i < programs.size(); i++){
+                if (programs[i].resident < state.PROGSIZE && programs[i].resident < programs[i].getSize()) return false;
+            }
+            return true;
+        }
+
+        void runParallel(const Reference* refs, size_t count, int threads){
+            // The TLB is shared by every program, so it also keeps the run on one thread
+            if (state.ALLOC != LOCAL || state.tlb.enabled() || threads < 2 || programs.size() < 2 || !framesSettled()){
+                run(refs, count);
+                return;
+            }
+            int slots = std::min((size_t)threads, programs.size());
+            if (startWorkers(slots)){
+                // The first chunk is shared out by its own references, later ones by the chunk before them
+                parallel.references.assign(programs.size(), 0);
+                for (size_t i = 0; i < count; i++) ++parallel.references[refs[i].pid];
+                balanceSlots(slots);
+            }
+            parallel.refs = refs;
+            parallel.count = count;
+            unsigned long before = 0, after = 0;
+            for (size_t i = 0; i < programs.size(); i++){
+                parallel.references[i] = programs[i].time;
+                before += programs[i].faults;
+            }
+
+            pthread_barrier_wait(&parallel.start);
+            runSlot(0);
+            pthread_barrier_wait(&parallel.done);
+
+            for (size_t i = 0; i < programs.size(); i++){
+                parallel.references[i] = programs[i].time - parallel.references[i];
+                after += programs[i].faults;
+            }
+            state.PSCOUNT += after - before;
+            state.RCOUNT += count;
+            balanceSlots(slots);
+        }
+
+        unsigned long faults(){
+            return state.PSCOUNT;
+        }
+
+        PrefetchStats prefetches(){
+            PrefetchStats total;
+            for (size_t i = 0; i < programs.size(); i++){
+                PrefetchStats program = programs[i].getPrefetches();
+                total.issued += program.issued;
+                total.useful += program.useful;
+                total.wasted += program.wasted;
+            }
+            return total;
+        }
+
+        TranslationStats translation(){
+            return state.tlb.stats;
+        }
+
+        std::vector<ProcessStats> processStats(){
+            std::vector<ProcessStats> stats;
+            for (size_t i = 0; i < programs.size(); i++) stats.push_back(programs[i].getStats());
+            return stats;
+        }
+
+        // Copy and paste this to print page table to check values at a certain point (It'll be really long if size of page is small)
+        void print(){
+            for (size_t i = 0; i < programs.size(); i++){
+                programs[i].print();
+            }
+        }
+};
+
+template<class Policy>
+Simulation* makeSimulationOf(const std::vector<Process>& processes, int SOP, string pre_paging, const std::vector<Reference>* trace){
+    if (Policy::OFFLINE && trace == NULL){
+        std::cout << Policy::name() << " needs the whole trace up front" << std::endl;
+        return NULL;
+    }
+    if (pre_paging == "+") return new SimulationOf<Policy, true>(processes, SOP, trace);
+    return new SimulationOf<Policy, false>(processes, SOP, trace);
+}
+
+// Picks the specialization for an algorithm (FIFO, LRU, Clock, OPT, ARC, CAR, 2Q, or CLOCK-Pro) and pre-paging setting ('+' or '-').
+// OPT also needs the trace it will be run over. Returns NULL for an unknown algorithm.
+Simulation* makeSimulation(const std::vector<Process>& processes, int SOP, string algo, string pre_paging, const std::vector<Reference>* trace = NULL){
+    if (algo == FIFOPolicy::name()) return makeSimulationOf<FIFOPolicy>(processes, SOP, pre_paging, trace);
+    if (algo == LRUPolicy::name()) return makeSimulationOf<LRUPolicy>(processes, SOP, pre_paging, trace);
+    if (algo == ClockPolicy::name()) return makeSimulationOf<ClockPolicy>(processes, SOP, pre_paging, trace);
+    if (algo == OPTPolicy::name()) return makeSimulationOf<OPTPolicy>(processes, SOP, pre_paging, trace);
+    if (algo == ARCPolicy::name()) return makeSimulationOf<ARCPolicy>(processes, SOP, pre_paging, trace);
+    if (algo == CARPolicy::name()) return makeSimulationOf<CARPolicy>(processes, SOP, pre_paging, trace);
+    if (algo == TwoQPolicy::name()) return makeSimulationOf<TwoQPolicy>(processes, SOP, pre_paging, trace);
+    if (algo == ClockProPolicy::name()) return makeSimulationOf<ClockProPolicy>(processes, SOP, pre_paging, trace);
+    std::cout << "Unknown algorithm: " << algo << std::endl;
+    return NULL;
+}
+
+// Binary trace format
+// Header: "PTRB" | u32 version | u32 process count | (u32 pid, u64 size) for each process
+// Block:  u32 record count | u32 payload bytes | payload
+// Each record in the payload is varint(pid) followed by varint(zigzag(address - previous address of that pid)).
+// Previous addresses restart at 0 in every block so each block can be decoded on its own.
+// All fixed width fields are little endian.
+const char TRACE_MAGIC[4] = {'P', 'T', 'R', 'B'};
+const uint32_t TRACE_VERSION = 1;
+const uint32_t TRACE_BLOCK_RECORDS = 4096;  // Records per block written by the converter
+const uint32_t TRACE_MAX_BLOCK = 1 << 26;    // Largest block payload a reader accepts, in bytes
+
+// Writes references into the binary trace format one block at a time
+class TraceWriter{
+    private:
+        FILE* out;
+        uint32_t count;                         // Records in the current block
+        std::vector<unsigned char> payload;     // Encoded records of the current block
+        std::vector<unsigned long> last;        // Previous address of each pid within the current block
+
+        void putFixed(uint64_t value, int bytes){
+            for (int i = 0; i < bytes; i++) fputc((value >> (8*i)) & 0xff, out);
+        }
+
+        void putVarint(uint64_t value){
+            while (value >= 0x80){
+                payload.push_back((value & 0x7f) | 0x80);
+                value >>= 7;
+            }
+            payload.push_back(value);
+        }
+
+    public:
+        TraceWriter(FILE* out, const std::vector<Process>& processes) : out(out), count(0){
+            fwrite(TRACE_MAGIC, 1, 4, out);
+            putFixed(TRACE_VERSION, 4);
+            putFixed(processes.size(), 4);
+            for (size_t i = 0; i < processes.size(); i++){
+                putFixed(processes[i].id, 4);
+                putFixed(processes[i].size, 8);
+            }
+        }
+
+        void write(const Reference& ref){
+            if ((size_t)ref.pid >= last.size()) last.resize(ref.pid + 1, 0);
+            int64_t delta = (int64_t)ref.address - (int64_t)last[ref.pid];
+            last[ref.pid] = ref.address;
+            putVarint(ref.pid);
+            putVarint(((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+            if (++count == TRACE_BLOCK_RECORDS) flush();
+        }
+
+        // Writes out the current block, if it has anything in it
+        void flush(){
+            if (count == 0) return;
+            putFixed(count, 4);
+            putFixed(payload.size(), 4);
+            fwrite(payload.data(), 1, payload.size(), out);
+            payload.clear();
+            std::fill(last.begin(), last.end(), 0);
+            count = 0;
+        }
+};
+
+// Streams references out of a text ("pid address" per line) or binary trace.
+// The format is detected from the first bytes so the reader works on files and pipes alike.
+class TraceReader{
+    private:
+        FILE* in;
+        std::vector<unsigned char> buffer;  // Text: raw read buffer. Binary: payload of the current block.
+        size_t pos, end;                    // Read position and valid length of buffer
+        size_t blockEnd;                    // End of the current binary block's payload in buffer
+        uint32_t remaining;                 // Records left in the current binary block
+        std::vector<unsigned long> last;    // Previous address of each pid within the current block
+        const std::vector<Process>* limits; // Processes every reference has to fall inside, if set
+
+        // Stops reading for good and keeps the reason. Returns false so it can end whatever read was going on.
+        bool fail(string message){
+            if (error.empty()) error = message;
+            in = NULL;
+            return false;
+        }
+
+        // Fills the buffer keeping whatever hasn't been consumed yet. Returns false at end of input.
+        bool refill(){
+            if (pos > 0){
+                std::copy(buffer.begin() + pos, buffer.begin() + end, buffer.begin());
+                end -= pos;
+                pos = 0;
+            }
+            size_t got = fread(buffer.data() + end, 1, buffer.size() - end, in);
+            end += got;
+            return got > 0;
+        }
+
+        bool readFixed(uint64_t& value, size_t bytes){
+            value = 0;
+            while (end - pos < bytes) if (!refill()) return false;
+            for (size_t i = 0; i < bytes; i++) value |= (uint64_t)buffer[pos++] << (8*i);
+            return true;
+        }
+
+        // Decodes a varint, which has to end inside the current block
+        bool getVarint(uint64_t& value){
+            value = 0;
+            for (int shift = 0; shift < 64 && pos < blockEnd; shift += 7){
+                unsigned char byte = buffer[pos++];
+                value |= (uint64_t)(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) return true;
+            }
+            return fail("Corrupt trace: a record runs past the end of its block");
+        }
+
+        // Loads the next block's payload into the buffer. Returns false at the end of the trace, which has to fall between blocks.
+        bool nextBlock(){
+            uint64_t count, bytes;
+            if (pos == end && !refill()) return false;
+            if (!readFixed(count, 4) || !readFixed(bytes, 4)) return fail("Truncated trace: a block header is cut short");
+            // Grow the buffer if the block doesn't fit, then pull the whole payload in.
+            // A block far bigger than any writer makes means the trace is corrupt.
+            if (bytes > TRACE_MAX_BLOCK || (count == 0) != (bytes == 0)) return fail("Corrupt trace: bad block header");
+            if (buffer.size() < bytes) buffer.resize(bytes);
+            while (end - pos < bytes) if (!refill()) return fail("Truncated trace: a block is cut short");
+            blockEnd = pos + bytes;
+            remaining = count;
+            std::fill(last.begin(), last.end(), 0);
+            return true;
+        }
+
+        bool nextBinary(Reference& ref){
+            while (remaining == 0) if (!nextBlock()) return false;
+            uint64_t pid, zigzag;
+            if (!getVarint(pid) || !getVarint(zigzag)) return false;
+            // Only processes from the header can appear, which also keeps a corrupt pid from sizing last
+            if (pid >= processes.size()) return fail("Corrupt trace: a record names a process missing from the header");
+            ref.pid = pid;
+            int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+            ref.address = last[pid] + delta;
+            last[pid] = ref.address;
+            // The records have to use up the block exactly
+            if (--remaining == 0 && pos != blockEnd) return fail("Corrupt trace: a block is longer than its records");
+            return true;
+        }
+
+        // Reads an unsigned decimal number, skipping any leading whitespace
+        bool readNumber(unsigned long& value){
+            while (true){
+                if (pos == end && !refill()) return false;
+                if (buffer[pos] >= '0' && buffer[pos] <= '9') break;
+                ++pos;
+            }
+            value = 0;
+            while (true){
+                if (pos == end && !refill()) return true;
+                if (buffer[pos] < '0' || buffer[pos] > '9') return true;
+                value = value*10 + (buffer[pos++] - '0');
+            }
+        }
+
+        bool nextText(Reference& ref){
+            unsigned long pid;
+            if (!readNumber(pid) || !readNumber(ref.address)) return false;
+            ref.pid = pid;
+            return true;
+        }
+
+    public:
+        bool binary;                        // True if the trace is in the binary format
+        std::vector<Process> processes;     // Process list from the binary header (empty for text)
+        string error;                       // Why a binary trace stopped early, empty if it didn't
+
+        TraceReader(FILE* in) : in(in), buffer(1 << 16), pos(0), end(0), blockEnd(0), remaining(0), limits(NULL), binary(false){
+            if (in == NULL) return;
+            while (end < 4 && refill());
+            binary = end >= 4 && std::equal(TRACE_MAGIC, TRACE_MAGIC + 4, buffer.begin());
+            if (binary){
+                pos = 4;
+                uint64_t version, count, id, size;
+                if (!readFixed(version, 4) || !readFixed(count, 4)){
+                    fail("Truncated trace: the header is cut short");
+                    return;
+                }
+                if (version != TRACE_VERSION){
+                    fail("Unsupported trace version: " + std::to_string(version));
+                    return;
+                }
+                for (uint64_t i = 0; i < count; i++){
+                    if (!readFixed(id, 4) || !readFixed(size, 8)){
+                        fail("Truncated trace: the process list is cut short");
+                        return;
+                    }
+                    Process process = {(int)id, (unsigned long)size};
+                    processes.push_back(process);
+                }
+                last.assign(processes.size(), 0);
+            }
+        }
+
+        // Makes every later reference have to name one of the given processes and an address inside it, since the
+        // simulator indexes by both. The list has to outlive the reader.
+        void checkAgainst(const std::vector<Process>& processes){
+            limits = &processes;
+        }
+
+        // Gets the next reference. Returns false at the end of the trace.
+        bool next(Reference& ref){
+            if (in == NULL) return false;
+            if (!(binary ? nextBinary(ref) : nextText(ref))) return false;
+            if (limits != NULL && ((size_t)ref.pid >= limits->size() || ref.address >= (*limits)[ref.pid].size)){
+                return fail("Reference out of range: process " + std::to_string(ref.pid) + ", address " + std::to_string(ref.address));
+            }
+            return true;
+        }
+};
+
+// Inputs read through a decompressor, which have to be closed with pclose
+std::vector<FILE*> PIPED_INPUTS;
+
+// Quotes a file name for the shell
+string shellQuote(string name){
+    string quoted = "'";
+    for (size_t i = 0; i < name.size(); i++){
+        if (name[i] == '\'') quoted += "'\\''";
+        else quoted += name[i];
+    }
+    return quoted + "'";
+}
+
+bool endsWith(string name, string suffix){
+    return name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Opens the given trace or list file. '-' is standard input, and named pipes open like files.
+// Otherwise the name is tried as is first and then with ".txt" added.
+// A gzip or zstd file, found by its first bytes or, for pipes, its extension, is read through gzip -dc or zstd -dc,
+// so it's decompressed as it streams in and never stored.
+FILE* openInput(string name){
+    if (name == "-") return stdin;
+    struct stat info;
+    if (stat(name.c_str(), &info) != 0){
+        name += ".txt";
+        if (stat(name.c_str(), &info) != 0) return NULL;
+    }
+
+    const char* tool = NULL;
+    FILE* f = NULL;
+    if (S_ISREG(info.st_mode)){
+        // Only a regular file can be read back from the start after looking at its first bytes
+        f = fopen(name.c_str(), "rb");
+        if (f == NULL) return NULL;
+        unsigned char magic[4] = {0, 0, 0, 0};
+        size_t got = fread(magic, 1, 4, f);
+        if (got >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) tool = "gzip -dc ";
+        else if (got == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) tool = "zstd -dc ";
+        if (tool == NULL){
+            rewind(f);
+            return f;
+        }
+        fclose(f);
+    }else if (endsWith(name, ".gz")) tool = "gzip -dc ";
+    else if (endsWith(name, ".zst")) tool = "zstd -dc ";
+    else return fopen(name.c_str(), "rb");
+
+    f = popen((tool + shellQuote(name)).c_str(), "r");
+    if (f != NULL) PIPED_INPUTS.push_back(f);
+    return f;
+}
+
+// Closes a file from openInput
+void closeInput(FILE* f){
+    if (f == NULL || f == stdin) return;
+    std::vector<FILE*>::iterator piped = std::find(PIPED_INPUTS.begin(), PIPED_INPUTS.end(), f);
+    if (piped != PIPED_INPUTS.end()){
+        PIPED_INPUTS.erase(piped);
+        pclose(f);
+    }else fclose(f);
+}
+
+// Reads a plist file into a list of processes
+std::vector<Process> readPlist(FILE* f){
+    std::vector<Process> processes;
+    TraceReader reader(f);
+    Reference entry;
+    while (reader.next(entry)){
+        Process process = {entry.pid, entry.address};
+        processes.push_back(process);
+    }
+    if (!reader.error.empty()) std::cout << reader.error << std::endl;
+    return processes;
+}
+
+// Gets the process list for a trace: from the plist file, or from the trace header when plist is '-'.
+// The trace is then held to the list. Returns false, after saying why, if there's no list or it's empty.
+bool loadProcesses(string plist, TraceReader& trace, std::vector<Process>& processes){
+    if (!trace.error.empty()){
+        std::cout << trace.error << std::endl;
+        return false;
+    }
+    if (plist == "-") processes = trace.processes;
+    else {
+        FILE* pf = openInput(plist);
+        if (pf == NULL){
+            std::cout << "Could not open " << plist << std::endl;
+            return false;
+        }
+        processes = readPlist(pf);
+        closeInput(pf);
+    }
+    if (processes.empty()){
+        std::cout << "No processes in " << (plist == "-" ? "the trace header" : plist) << std::endl;
+        return false;
+    }
+    trace.checkAgainst(processes);
+    return true;
+}
+
+// Converts a text plist and ptrace into a single binary trace
+int convert(string plist, string ptrace, string output){
+    FILE* pf = openInput(plist);
+    FILE* tf = openInput(ptrace);
+    FILE* out = fopen(output.c_str(), "wb");
+    if (pf == NULL || tf == NULL || out == NULL){
+        std::cout << "Could not open " << (pf == NULL ? plist : tf == NULL ? ptrace : output) << std::endl;
+        return -1;
+    }
+    TraceWriter writer(out, readPlist(pf));
+    TraceReader reader(tf);
+    Reference ref;
+    unsigned long count = 0;
+    while (reader.next(ref)){
+        writer.write(ref);
+        ++count;
+    }
+    writer.flush();
+    closeInput(pf);
+    closeInput(tf);
+    fclose(out);
+    if (!reader.error.empty()){
+        std::cout << reader.error << std::endl;
+        return -1;
+    }
+    std::cout << "Converted " << count << " references into " << output << std::endl;
+    return 0;
+}
+
+// Access patterns the generator can give a process
+//   uniform  any location, equally likely
+//   zipf     location k+1 referenced about 1/(k+1)^ZIPF_EXPONENT as often as location 0, a hot set at the start of the process
+//   loop     scans the first LOOP_LENGTH locations over and over (the whole process if 0)
+//   stride   walks the whole process STRIDE locations at a time, wrapping around
+//   phase    uniform over a hot set of an eighth of the process, which moves somewhere else every PHASE_LENGTH references
+//   mix      the patterns above in turn, one per process
+const char* PATTERNS[] = {"uniform", "zipf", "loop", "stride", "phase"};
+const int PATTERN_COUNT = 5;
+double ZIPF_EXPONENT = 0.99;
+unsigned long LOOP_LENGTH = 0;
+unsigned long STRIDE = 8;
+unsigned long PHASE_LENGTH = 10000;
+
+// Makes up references for a set of processes. Each reference goes to a process picked at random, and every process
+// keeps its own position so its stream stays in pattern however the processes are interleaved.
+class TraceGenerator{
+    private:
+        struct Stream{
+            int pattern;
+            unsigned long size;
+            unsigned long position;     // Next location for loop and stride
+            unsigned long hotStart;     // Start of the hot set for phase
+            unsigned long count;        // References made so far
+        };
+        std::mt19937_64 rng;
+        std::vector<Stream> streams;
+
+        double uniform(){
+            return (rng() >> 11)*(1.0/9007199254740992.0);
+        }
+
+        // Zipf by inverting the continuous power law over [1, n+1). Returns a location in [0, n).
+        unsigned long zipf(unsigned long n){
+            double u = uniform(), x;
+            if (std::fabs(ZIPF_EXPONENT - 1) < 1e-9) x = std::pow(n + 1.0, u);
+            else {
+                double a = 1 - ZIPF_EXPONENT;
+                x = std::pow((std::pow(n + 1.0, a) - 1)*u + 1, 1/a);
+            }
+            unsigned long rank = x;
+            return std::min(std::max(rank, 1UL), n) - 1;
+        }
+
+    public:
+        std::vector<Process> processes;
+
+        // pattern is one of PATTERNS or "mix". Sizes are picked uniformly between minSize and maxSize.
+        TraceGenerator(int count, unsigned long minSize, unsigned long maxSize, int pattern, unsigned long seed) : rng(seed){
+            for (int i = 0; i < count; i++){
+                Stream stream;
+                stream.pattern = pattern < 0 ? i % PATTERN_COUNT : pattern;
+                stream.size = minSize + rng() % (maxSize - minSize + 1);
+                stream.position = 0;
+                stream.hotStart = 0;
+                stream.count = 0;
+                streams.push_back(stream);
+                Process process = {i, stream.size};
+                processes.push_back(process);
+            }
+        }
+
+        Reference next(){
+            Reference ref;
+            ref.pid = rng() % streams.size();
+            Stream& s = streams[ref.pid];
+            switch (s.pattern){
+                case 0:
+                    ref.address = rng() % s.size;
+                    break;
+                case 1:
+                    ref.address = zipf(s.size);
+                    break;
+                case 2:
+                    ref.address = s.position;
+                    if (++s.position >= (LOOP_LENGTH > 0 ? std::min(LOOP_LENGTH, s.size) : s.size)) s.position = 0;
+                    break;
+                case 3:
+                    ref.address = s.position;
+                    s.position = (s.position + STRIDE) % s.size;
+                    break;
+                default:{
+                    unsigned long hot = std::max(1UL, s.size/8);
+                    if (s.count % PHASE_LENGTH == 0) s.hotStart = rng() % (s.size - hot + 1);
+                    ref.address = s.hotStart + rng() % hot;
+                }
+            }
+            ++s.count;
+            return ref;
+        }
+};
+
+// Writes a synthetic trace: plist and ptrace as text, or one binary trace to ptrace.
+// ptrace may be '-' for standard output so the trace can be piped straight into the simulator without being stored,
+// and plist may be '-' for a binary trace since its header carries the process list.
+int generate(string plist, string ptrace, int count, unsigned long references, string pattern, unsigned long minSize, unsigned long maxSize,
+             unsigned long seed, bool binary){
+    int kind = -1;
+    for (int i = 0; i < PATTERN_COUNT; i++) if (pattern == PATTERNS[i]) kind = i;
+    if (kind < 0 && pattern != "mix"){
+        std::cout << "Unknown pattern: " << pattern << std::endl;
+        return -1;
+    }
+    if (count < 1 || minSize < 1 || maxSize < minSize){
+        std::cout << "Need at least one process of at least one location" << std::endl;
+        return -1;
+    }
+    if (plist == "-" && ptrace == "-" && !binary){
+        std::cout << "The plist and a text ptrace can't both go to standard output" << std::endl;
+        return -1;
+    }
+    TraceGenerator generator(count, minSize, maxSize, kind, seed);
+
+    // A binary trace carries the process list, so a plist of '-' is left out. With a text trace it goes to standard output.
+    if (plist != "-" || !binary){
+        FILE* pf = plist == "-" ? stdout : fopen(plist.c_str(), "w");
+        if (pf == NULL){
+            std::cout << "Could not open " << plist << std::endl;
+            return -1;
+        }
+        for (size_t i = 0; i < generator.processes.size(); i++) fprintf(pf, "%d %lu\n", generator.processes[i].id, generator.processes[i].size);
+        if (pf == stdout) fflush(pf);
+        else fclose(pf);
+    }
+
+    FILE* out = ptrace == "-" ? stdout : fopen(ptrace.c_str(), binary ? "wb" : "w");
+    if (out == NULL){
+        std::cout << "Could not open " << ptrace << std::endl;
+        return -1;
+    }
+    std::vector<char> buffer(1 << 16);
+    setvbuf(out, buffer.data(), _IOFBF, buffer.size());
+    if (binary){
+        TraceWriter writer(out, generator.processes);
+        for (unsigned long i = 0; i < references; i++) writer.write(generator.next());
+        writer.flush();
+    }else{
+        for (unsigned long i = 0; i < references; i++){
+            Reference ref = generator.next();
+            fprintf(out, "%d %lu\n", ref.pid, ref.address);
+        }
+    }
+    if (out == stdout) fflush(out);
+    else fclose(out);
+    return 0;
+}
+
+// Output formats for classic mode and sweep, picked with -format
+enum Format { TEXT, CSV, JSON };
+
+double rateOf(unsigned long part, unsigned long whole){
+    return whole > 0 ? double(part)/double(whole) : 0.0;
+}
+
+// One configuration of a sweep and the number of faults it produced
+struct SweepJob{
+    int SOP;
+    string algo;
+    string pre_paging;
+    unsigned long faults;
+    PrefetchStats prefetches;
+    TranslationStats translation;
+    bool started;               // Set once a worker has tried to make its simulation
+    Simulation* sim;
+};
+
+// References read and simulated at a time by sweep, which bounds its memory whatever the length of the trace
+const size_t SWEEP_CHUNK = 1 << 20;
+
+// State shared by the sweep worker threads. The chunk of the trace is only read, jobs are handed out under the mutex.
+struct SweepShared{
+    const std::vector<Process>* processes;
+    const std::vector<Reference>* trace;    // Current chunk, the whole trace when an offline policy is swept
+    std::vector<SweepJob>* jobs;
+    size_t next;                // Next job to hand out
+    pthread_mutex_t mutex;
+};
+
+// Worker thread: keeps taking the next job and simulating it over the current chunk until none are left.
+// A job's simulation is made on its first chunk and kept for the following ones.
+void* sweepWorker(void* arg){
+    SweepShared* shared = (SweepShared*) arg;
+    while (true){
+        pthread_mutex_lock(&shared->mutex);
+        size_t job = shared->next++;
+        pthread_mutex_unlock(&shared->mutex);
+        if (job >= shared->jobs->size()) break;
+
+        SweepJob& config = (*shared->jobs)[job];
+        if (!config.started){
+            config.started = true;
+            config.sim = makeSimulation(*shared->processes, config.SOP, config.algo, config.pre_paging, shared->trace);
+        }
+        if (config.sim == NULL) continue;
+        const std::vector<Reference>& trace = *shared->trace;
+        config.sim->run(trace.data(), trace.size());
+        config.faults = config.sim->faults();
+        config.prefetches = config.sim->prefetches();
+        config.translation = config.sim->translation();
+    }
+    return NULL;
+}
+
+// Splits a comma separated list
+std::vector<string> splitList(string list){
+    std::vector<string> items;
+    std::stringstream ss(list);
+    string item;
+    while (getline(ss, item, ',')) if (item.length() != 0) items.push_back(item);
+    return items;
+}
+
+// Reads a whole trace into memory. Returns false if the trace can't be opened.
+bool loadTrace(string plist, string ptrace, std::vector<Process>& processes, std::vector<Reference>& trace){
+    FILE* tf = openInput(ptrace);
+    if (tf == NULL){
+        std::cout << "Could not open " << ptrace << std::endl;
+        return false;
+    }
+    TraceReader reader(tf);
+    if (!loadProcesses(plist, reader, processes)){
+        closeInput(tf);
+        return false;
+    }
+    Reference ref;
+    while (reader.next(ref)) trace.push_back(ref);
+    closeInput(tf);
+    if (!reader.error.empty()){
+        std::cout << reader.error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Every combination of the comma separated page sizes, algorithms and pre-paging settings
+std::vector<SweepJob> makeJobs(string sizes, string algos, string pagings){
+    std::vector<SweepJob> jobs;
+    std::vector<string> sizeList = splitList(sizes), algoList = splitList(algos), pagingList = splitList(pagings);
+    for (size_t i = 0; i < sizeList.size(); i++){
+        for (size_t j = 0; j < algoList.size(); j++){
+            for (size_t k = 0; k < pagingList.size(); k++){
+                SweepJob job = {atoi(sizeList[i].c_str()), algoList[j], pagingList[k], 0, PrefetchStats(), TranslationStats(), false, NULL};
+                jobs.push_back(job);
+            }
+        }
+    }
+    return jobs;
+}
+
+// Simulates every combination of the given page sizes, algorithms and pre-paging settings.
+// The trace is parsed once, a chunk at a time, and every combination is simulated from the same chunk on worker threads.
+// Only sweeping OPT, which looks ahead, reads the whole trace in first.
+int sweep(string plist, string ptrace, string sizes, string algos, string pagings, int threads, Format format){
+    FILE* tf = openInput(ptrace);
+    if (tf == NULL){
+        std::cout << "Could not open " << ptrace << std::endl;
+        return -1;
+    }
+    TraceReader reader(tf);
+    std::vector<Process> processes;
+    if (!loadProcesses(plist, reader, processes)){
+        closeInput(tf);
+        return -1;
+    }
+    std::vector<SweepJob> jobs = makeJobs(sizes, algos, pagings);
+    bool offline = false;
+    for (size_t i = 0; i < jobs.size(); i++) if (jobs[i].algo == OPTPolicy::name()) offline = true;
+
+    std::vector<Reference> trace;
+    SweepShared shared;
+    shared.processes = &processes;
+    shared.trace = &trace;
+    shared.jobs = &jobs;
+    pthread_mutex_init(&shared.mutex, NULL);
+    if ((size_t)threads > jobs.size()) threads = jobs.size();
+    std::vector<pthread_t> workers(threads);
+    unsigned long references = 0;
+    Reference ref;
+    while (true){
+        trace.clear();
+        while ((offline || trace.size() < SWEEP_CHUNK) && reader.next(ref)) trace.push_back(ref);
+        if (trace.empty() && references > 0) break;
+        references += trace.size();
+        shared.next = 0;
+        for (int i = 0; i < threads; i++) pthread_create(&workers[i], NULL, sweepWorker, &shared);
+        for (int i = 0; i < threads; i++) pthread_join(workers[i], NULL);
+        if (trace.empty()) break;
+    }
+    pthread_mutex_destroy(&shared.mutex);
+    closeInput(tf);
+    for (size_t i = 0; i < jobs.size(); i++) delete jobs[i].sim;
+    if (!reader.error.empty()){
+        std::cout << reader.error << std::endl;
+        return -1;
+    }
+
+    // The translation columns only appear with the TLB model on
+    bool tlb = TLB_ENTRIES > 0;
+    if (format == CSV){
+        printf("page_size,algorithm,pre_paging,faults,prefetched,useful,wasted,fault_rate%s\n", tlb ? ",tlb_hit_rate,page_walks,cycles_per_reference" : "");
+    }else if (format == JSON){
+        printf("{\"references\": %lu, \"runs\": [", references);
+    }else{
+        printf("%10s %10s %11s %12s %11s %11s %11s", "Page Size", "Algorithm", "Pre-paging", "Page Faults", "Prefetched", "Useful", "Wasted");
+        if (tlb) printf(" %10s %11s %11s", "TLB Hit %", "Page Walks", "Cycles/ref");
+        printf("\n");
+    }
+    for (size_t i = 0; i < jobs.size(); i++){
+        SweepJob& job = jobs[i];
+        TranslationStats& t = job.translation;
+        double cycles = t.lookups > 0 ? translationCycles(t, job.faults)/t.lookups : 0.0;
+        if (format == CSV){
+            printf("%d,%s,%s,%lu,%lu,%lu,%lu,%.6f", job.SOP, job.algo.c_str(), job.pre_paging.c_str(), job.faults, job.prefetches.issued,
+                   job.prefetches.useful, job.prefetches.wasted, rateOf(job.faults, references));
+            if (tlb) printf(",%.6f,%lu,%.2f", rateOf(t.hits, t.lookups), t.walks, cycles);
+            printf("\n");
+        }else if (format == JSON){
+            printf("%s\n  {\"page_size\": %d, \"algorithm\": \"%s\", \"pre_paging\": \"%s\", \"faults\": %lu, \"prefetched\": %lu, \"useful\": %lu, "
+                   "\"wasted\": %lu, \"fault_rate\": %.6f", i > 0 ? "," : "", job.SOP, job.algo.c_str(), job.pre_paging.c_str(), job.faults,
+                   job.prefetches.issued, job.prefetches.useful, job.prefetches.wasted, rateOf(job.faults, references));
+            if (tlb) printf(", \"tlb_hit_rate\": %.6f, \"page_walks\": %lu, \"cycles_per_reference\": %.2f", rateOf(t.hits, t.lookups), t.walks, cycles);
+            printf("}");
+        }else{
+            printf("%10d %10s %11s %12lu %11lu %11lu %11lu", job.SOP, job.algo.c_str(), job.pre_paging.c_str(), job.faults,
+                   job.prefetches.issued, job.prefetches.useful, job.prefetches.wasted);
+            if (tlb) printf(" %10.2f %11lu %11.2f", 100.0*rateOf(t.hits, t.lookups), t.walks, cycles);
+            printf("\n");
+        }
+    }
+    if (format == JSON) printf("]}\n");
+    else if (format == TEXT) std::cout << "References: " << references << std::endl;
+    return 0;
+}
+
+// Times the simulation kernel for every combination, one at a time. With more than one thread, the programs of each run are
+// simulated in parallel (local allocation only).
+// The trace is parsed into memory first so only the reference loop is measured. Each run is repeated and the fastest is kept.
+int bench(string plist, string ptrace, string sizes, string algos, string pagings, int repeat, int threads){
+    std::vector<Process> processes;
+    std::vector<Reference> trace;
+    if (!loadTrace(plist, ptrace, processes, trace)) return -1;
+    std::vector<SweepJob> jobs = makeJobs(sizes, algos, pagings);
+
+    printf("%10s %10s %11s %12s %14s %10s\n", "Page Size", "Algorithm", "Pre-paging", "Page Faults", "References/s", "ns/ref");
+    for (size_t i = 0; i < jobs.size(); i++){
+        double best = 0;
+        for (int r = 0; r < repeat; r++){
+            Simulation* sim = makeSimulation(processes, jobs[i].SOP, jobs[i].algo, jobs[i].pre_paging, &trace);
+            if (sim == NULL) break;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            sim->runParallel(trace.data(), trace.size(), threads);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (r == 0 || seconds < best) best = seconds;
+            jobs[i].faults = sim->faults();
+            delete sim;
+        }
+        printf("%10d %10s %11s %12lu %14.0f %10.2f\n", jobs[i].SOP, jobs[i].algo.c_str(), jobs[i].pre_paging.c_str(), jobs[i].faults,
+               best > 0 ? trace.size()/best : 0.0, trace.size() > 0 ? best*1e9/trace.size() : 0.0);
+    }
+    std::cout << "References: " << trace.size() << " Threads: " << threads << std::endl;
+    return 0;
+}
+
+// Fixed benchmark suite for the paging engine. Every case is a synthetic trace made from a fixed seed, so runs on different
+// builds see the same references and can be compared against a saved baseline.
+// The traces cover process counts, page sizes and three levels of locality:
+//   hot      Zipf skewed towards a small hot set, mostly hits, so it mostly times checkMain
+//   phase    a moving hot set, a mix of hits and faults
+//   uniform  no locality, mostly faults, so it mostly times the policy and swapIn
+const int SUITE_PROCESSES[] = {2, 8, 32};
+const int SUITE_SIZES[] = {1, 4, 16};
+const char* SUITE_LOCALITIES[] = {"hot", "phase", "uniform"};
+const char* SUITE_ALGOS[] = {"FIFO", "LRU", "Clock"};
+
+// One benchmark case and its fastest run
+struct BenchCase{
+    string name;
+    int processes;
+    int SOP;
+    string locality;
+    string algo;
+    unsigned long references;
+    unsigned long faults;
+    unsigned long allocations;      // Heap allocations during the run, not counting setup, with -DCOUNT_ALLOCATIONS
+    double seconds;
+};
+
+// Makes the suite trace for a process count and locality
+void suiteTrace(int count, string locality, unsigned long references, std::vector<Process>& processes, std::vector<Reference>& trace){
+    double exponent = ZIPF_EXPONENT;
+    unsigned long phase = PHASE_LENGTH;
+    ZIPF_EXPONENT = 1.2;
+    PHASE_LENGTH = 20000;
+    int pattern = locality == "hot" ? 1 : locality == "phase" ? 4 : 0;
+    TraceGenerator generator(count, 512, 2048, pattern, 492 + count);
+    processes = generator.processes;
+    trace.clear();
+    for (unsigned long i = 0; i < references; i++) trace.push_back(generator.next());
+    ZIPF_EXPONENT = exponent;
+    PHASE_LENGTH = phase;
+}
+
+// Reads the refs_per_sec of every case in a JSON file written by suite -json
+std::map<string, double> readBaseline(string name){
+    std::map<string, double> baseline;
+    std::ifstream in(name.c_str());
+    string line;
+    while (getline(in, line)){
+        size_t key = line.find("\"case\": \"");
+        size_t rate = line.find("\"refs_per_sec\": ");
+        if (key == string::npos || rate == string::npos) continue;
+        key += 9;
+        baseline[line.substr(key, line.find('"', key) - key)] = atof(line.c_str() + rate + 16);
+    }
+    return baseline;
+}
+
+// Allocations per fault as text, or the placeholder when the build doesn't count allocations
+string allocationsPerFault(const BenchCase& c, string placeholder){
+    if (!COUNTING_ALLOCATIONS) return placeholder;
+    char text[32];
+    snprintf(text, sizeof(text), "%.4f", c.faults > 0 ? double(c.allocations)/c.faults : 0.0);
+    return text;
+}
+
+void writeBenchJson(FILE* out, const std::vector<BenchCase>& cases){
+    fprintf(out, "{\"cases\": [");
+    for (size_t i = 0; i < cases.size(); i++){
+        const BenchCase& c = cases[i];
+        fprintf(out, "%s\n  {\"case\": \"%s\", \"processes\": %d, \"page_size\": %d, \"locality\": \"%s\", \"algorithm\": \"%s\", "
+                "\"references\": %lu, \"faults\": %lu, \"hit_ratio\": %.6f, \"refs_per_sec\": %.0f, \"ns_per_fault\": %.2f, \"allocs_per_fault\": %s}",
+                i > 0 ? "," : "", c.name.c_str(), c.processes, c.SOP, c.locality.c_str(), c.algo.c_str(), c.references, c.faults,
+                1 - rateOf(c.faults, c.references), c.seconds > 0 ? c.references/c.seconds : 0.0,
+                c.faults > 0 ? c.seconds*1e9/c.faults : 0.0, allocationsPerFault(c, "null").c_str());
+    }
+    fprintf(out, "]}\n");
+}
+
+// Runs the suite and prints references per second, nanoseconds per fault (run time over faults) and, in a build with
+// -DCOUNT_ALLOCATIONS, allocations per fault.
+// jsonOut saves the results as a baseline, and a baseline given in baselineIn is compared against: a case more than
+// tolerance slower than its baseline is reported, and makes the suite return 1.
+int suite(unsigned long references, int repeat, string jsonOut, string baselineIn, double tolerance){
+    std::map<string, double> baseline;
+    if (baselineIn.length() != 0) baseline = readBaseline(baselineIn);
+    std::vector<BenchCase> cases;
+    std::vector<Process> processes;
+    std::vector<Reference> trace;
+    int regressions = 0;
+
+    printf("%-24s %8s %14s %10s %12s", "Case", "Hit %", "References/s", "ns/fault", "allocs/fault");
+    if (baseline.size() > 0) printf(" %10s", "vs base");
+    printf("\n");
+    for (int p = 0; p < 3; p++){
+        for (int l = 0; l < 3; l++){
+            suiteTrace(SUITE_PROCESSES[p], SUITE_LOCALITIES[l], references, processes, trace);
+            for (int s = 0; s < 3; s++){
+                for (int a = 0; a < 3; a++){
+                    // Named like p8_hot_s4_LRU, the same as assign2_alt's bench names a run over the trace written as p8_hot
+                    string name = "p" + to_string(SUITE_PROCESSES[p]) + "_" + SUITE_LOCALITIES[l] + "_s" + to_string(SUITE_SIZES[s]) + "_" + SUITE_ALGOS[a];
+                    BenchCase c = {name, SUITE_PROCESSES[p], SUITE_SIZES[s], SUITE_LOCALITIES[l], SUITE_ALGOS[a], trace.size(), 0, 0, 0};
+                    for (int r = 0; r < repeat; r++){
+                        Simulation* sim = makeSimulation(processes, c.SOP, c.algo, "-");
+                        unsigned long allocations = ALLOCATIONS.load();
+                        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                        sim->run(trace.data(), trace.size());
+                        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                        c.allocations = ALLOCATIONS.load() - allocations;
+                        if (r == 0 || seconds < c.seconds) c.seconds = seconds;
+                        c.faults = sim->faults();
+                        delete sim;
+                    }
+                    cases.push_back(c);
+                }
+            }
+        }
+    }
+
+    // PhysicalMemory::swapIn on its own, one call per reference
+    BenchCase c = {"swapIn", 0, 1, "", "", references, references, 0, 0};
+    for (int r = 0; r < repeat; r++){
+        PhysicalMemory memory;
+        memory.initPhysicalMemory(1);
+        unsigned long allocations = ALLOCATIONS.load();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (unsigned long i = 0; i < references; i++) memory.swapIn(i, i % memory.size(), i & 7);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        c.allocations = ALLOCATIONS.load() - allocations;
+        if (r == 0 || seconds < c.seconds) c.seconds = seconds;
+        if (memory.getOwner(0) < 0) c.faults = 0;   // Keeps the loop from being optimized away
+    }
+    cases.push_back(c);
+
+    for (size_t i = 0; i < cases.size(); i++){
+        BenchCase& c = cases[i];
+        double rate = c.seconds > 0 ? c.references/c.seconds : 0.0;
+        printf("%-24s %8.2f %14.0f %10.2f %12s", c.name.c_str(), 100*(1 - rateOf(c.faults, c.references)), rate,
+               c.faults > 0 ? c.seconds*1e9/c.faults : 0.0, allocationsPerFault(c, "-").c_str());
+        if (baseline.count(c.name) && baseline[c.name] > 0){
+            double change = rate/baseline[c.name];
+            printf(" %9.2fx%s", change, change < 1 - tolerance ? " slower" : "");
+            if (change < 1 - tolerance) ++regressions;
+        }
+        printf("\n");
+    }
+
+    if (jsonOut.length() != 0){
+        FILE* out = jsonOut == "-" ? stdout : fopen(jsonOut.c_str(), "w");
+        if (out == NULL){
+            std::cout << "Could not open " << jsonOut << std::endl;
+            return -1;
+        }
+        writeBenchJson(out, cases);
+        if (out != stdout) fclose(out);
+    }
+    if (baseline.size() > 0) std::cout << regressions << " cases more than " << tolerance*100 << "% slower than the baseline" << std::endl;
+    return regressions > 0 ? 1 : 0;
+}
+
+// Writes the suite's traces as text plist and ptrace files, named like p8_hot_plist.txt, so other builds can run the same references
+int writeSuite(string directory, unsigned long references){
+    std::vector<Process> processes;
+    std::vector<Reference> trace;
+    for (int p = 0; p < 3; p++){
+        for (int l = 0; l < 3; l++){
+            suiteTrace(SUITE_PROCESSES[p], SUITE_LOCALITIES[l], references, processes, trace);
+            string base = directory + "/p" + to_string(SUITE_PROCESSES[p]) + "_" + SUITE_LOCALITIES[l];
+            FILE* pf = fopen((base + "_plist.txt").c_str(), "w");
+            FILE* tf = fopen((base + "_ptrace.txt").c_str(), "w");
+            if (pf == NULL || tf == NULL){
+                std::cout << "Could not write to " << directory << std::endl;
+                if (pf != NULL) fclose(pf);
+                if (tf != NULL) fclose(tf);
+                return -1;
+            }
+            for (size_t i = 0; i < processes.size(); i++) fprintf(pf, "%d %lu\n", processes[i].id, processes[i].size);
+            for (size_t i = 0; i < trace.size(); i++) fprintf(tf, "%d %lu\n", trace[i].pid, trace[i].address);
+            fclose(pf);
+            fclose(tf);
+        }
+    }
+    return 0;
+}
+
+// LRU stack distance analysis (Mattson et al.)
+// The stack distance of a reference is the number of distinct pages referenced since the last reference to the same page, counting itself.
+// LRU with m frames hits exactly the references with distance <= m, so a histogram of distances gives the faults for every memory size at once.
+// Distances are found with a Fenwick tree holding a 1 at every time that is still some page's most recent access.
+// When the clock reaches the end of the tree the live times are renumbered, so memory only grows with the number of distinct pages.
+class StackDistance{
+    private:
+        std::vector<unsigned long> tree;                            // Fenwick tree over access times (1-based)
+        std::unordered_map<unsigned long, unsigned long> lastAccess; // Page -> time of its most recent access
+        unsigned long time;                                         // Time of the latest access
+
+        void add(unsigned long i, long value){
+            for (; i < tree.size(); i += i & -i) tree[i] += value;
+        }
+
+        // Number of live times in [1, i]
+        unsigned long prefix(unsigned long i){
+            unsigned long sum = 0;
+            for (; i > 0; i -= i & -i) sum += tree[i];
+            return sum;
+        }
+
+        // Renumbers the most recent access of every page to 1..k keeping their order, and rebuilds the tree with room to spare
+        void compact(){
+            std::vector<std::pair<unsigned long, unsigned long>> live;     // (time, page)
+            live.reserve(lastAccess.size());
+            for (auto it = lastAccess.begin(); it != lastAccess.end(); ++it) live.push_back(std::make_pair(it->second, it->first));
+            std::sort(live.begin(), live.end());
+            tree.assign(std::max<size_t>(2*live.size(), 1024) + 1, 0);
+            for (size_t i = 0; i < live.size(); i++){
+                lastAccess[live[i].second] = i + 1;
+                add(i + 1, 1);
+            }
+            time = live.size();
+        }
+
+    public:
+        std::vector<unsigned long> histogram;   // histogram[d] is the number of references with stack distance d
+        unsigned long coldMisses;               // First references to a page, which fault at every memory size
+        unsigned long references;
+
+        StackDistance() : tree(1025, 0), time(0), histogram(1, 0), coldMisses(0), references(0){}
+
+        // Records a reference to the given page
+        void access(unsigned long page){
+            ++references;
+            if (time + 1 >= tree.size()) compact();
+            auto it = lastAccess.find(page);
+            if (it == lastAccess.end()){
+                ++coldMisses;
+                lastAccess[page] = ++time;
+            }else{
+                unsigned long distance = prefix(time) - prefix(it->second - 1);   // Live times in [last, now]
+                if (distance >= histogram.size()) histogram.resize(distance + 1, 0);
+                ++histogram[distance];
+                add(it->second, -1);
+                it->second = ++time;
+            }
+            add(time, 1);
+        }
+
+        // Number of distinct pages seen so far, which is also the largest useful memory size
+        unsigned long distinctPages(){
+            return lastAccess.size();
+        }
+
+        // Faults for every memory size from 0 to distinctPages() frames
+        std::vector<unsigned long> faultCurve(){
+            std::vector<unsigned long> faults(distinctPages() + 1, 0);
+            unsigned long misses = references;      // With 0 frames every reference faults
+            for (size_t m = 0; m < faults.size(); m++){
+                if (m < histogram.size()) misses -= histogram[m];
+                faults[m] = misses;
+            }
+            return faults;
+        }
+};
+
+// A miss ratio curve: estimated faults at a list of memory sizes (in frames)
+struct MissCurve{
+    std::vector<unsigned long> frames;
+    std::vector<double> faults;
+    unsigned long references;
+
+    double missRatio(size_t i){
+        return references > 0 ? faults[i]/double(references) : 0.0;
+    }
+};
+
+// The exact curve for every memory size a stack distance tracker has seen
+MissCurve exactCurve(StackDistance& stack){
+    MissCurve curve;
+    std::vector<unsigned long> faults = stack.faultCurve();
+    for (size_t m = 1; m < faults.size(); m++){
+        curve.frames.push_back(m);
+        curve.faults.push_back(faults[m]);
+    }
+    curve.references = stack.references;
+    return curve;
+}
+
+// Hashes a page key into a well mixed 64 bit value (splitmix64 finalizer)
+uint64_t hashPage(uint64_t key){
+    key += 0x9e3779b97f4a7c15ULL;
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return key ^ (key >> 31);
+}
+
+// Spatially hashed sampling of the stack distance computation (SHARDS, Waldspurger et al.)
+// A page is kept when its hash falls under a threshold, so a fraction R of the pages is tracked and every reference to a kept page is seen.
+// Distances on the sample are scaled up by 1/R and so are the counts. The number of sampled references is corrected
+// to its expected value N*R (SHARDS-adj) by adding the difference to the smallest distance.
+// Memory is proportional to R times the number of distinct pages, and time is dominated by hashing the unsampled references.
+class SampledStackDistance{
+    private:
+        static const uint64_t MODULUS = 1 << 24;
+        StackDistance sample;
+        uint64_t threshold;     // Pages with hash mod MODULUS below this are sampled
+        double rate;            // Fraction of pages sampled
+    public:
+        unsigned long references;  // All references, sampled or not
+
+        SampledStackDistance(double rate) : rate(rate), references(0){
+            threshold = rate*MODULUS;
+            if (threshold < 1) threshold = 1;
+            this->rate = double(threshold)/MODULUS;
+        }
+
+        void access(unsigned long page){
+            ++references;
+            if ((hashPage(page) % MODULUS) < threshold) sample.access(page);
+        }
+
+        // Estimated faults at the memory sizes the sample can resolve, which are multiples of 1/R frames
+        MissCurve curve(){
+            MissCurve curve;
+            curve.references = references;
+            double expected = references*rate;      // Sampled references we should have seen
+            double hits = expected - double(sample.references);
+            for (size_t d = 1; d <= sample.distinctPages(); d++){
+                if (d < sample.histogram.size()) hits += sample.histogram[d];
+                double faults = double(references) - hits/rate;
+                curve.frames.push_back((unsigned long)(d/rate + 0.5));
+                curve.faults.push_back(std::max(0.0, std::min(double(references), faults)));
+            }
+            return curve;
+        }
+};
+
+// Prints a miss ratio curve as CSV rows: scope, frames, memory locations, faults, miss ratio.
+// Given the exact curve as well, each row also gets the exact miss ratio and the absolute error, and the error bounds are returned.
+void printCurve(string scope, MissCurve curve, int SOP, StackDistance* exact, double& maxError, double& meanError){
+    std::vector<unsigned long> exactFaults;
+    if (exact != NULL) exactFaults = exact->faultCurve();
+    maxError = meanError = 0;
+    for (size_t i = 0; i < curve.frames.size(); i++){
+        printf("%s,%lu,%lu,%.0f,%.6f", scope.c_str(), curve.frames[i], curve.frames[i]*SOP, curve.faults[i], curve.missRatio(i));
+        if (exact != NULL){
+            // Beyond the largest distance only cold misses remain
+            unsigned long m = std::min<unsigned long>(curve.frames[i], exactFaults.size() - 1);
+            double exactRatio = exact->references > 0 ? double(exactFaults[m])/double(exact->references) : 0.0;
+            double error = fabs(curve.missRatio(i) - exactRatio);
+            maxError = std::max(maxError, error);
+            meanError += error;
+            printf(",%.6f,%.6f", exactRatio, error);
+        }
+        printf("\n");
+    }
+    if (curve.frames.size() > 0) meanError /= curve.frames.size();
+}
+
+// Computes LRU miss ratio curves for every memory size in one pass over the trace.
+// The global curve treats all programs as sharing memory, the per process curves assume each program has memory to itself.
+// Pages are demand loaded, so unlike the simulator nothing is resident before the first reference.
+// With a sample rate below 1 the curves are estimated from a spatially hashed sample of the pages. Comparing then also runs
+// the exact computation and reports the error of the estimate.
+int missRatioCurve(string plist, string ptrace, int SOP, double rate, bool compare){
+    FILE* tf = openInput(ptrace);
+    if (tf == NULL){
+        std::cout << "Could not open " << ptrace << std::endl;
+        return -1;
+    }
+    TraceReader reader(tf);
+    std::vector<Process> processes;
+    if (!loadProcesses(plist, reader, processes)){
+        closeInput(tf);
+        return -1;
+    }
+    bool sampled = rate < 1;
+    compare = compare && sampled;
+
+    StackDistance global;
+    std::vector<StackDistance> local(processes.size());
+    SampledStackDistance sampleGlobal(rate);
+    std::vector<SampledStackDistance> sampleLocal(processes.size(), SampledStackDistance(rate));
+    Reference ref;
+    unsigned long page;
+    while (reader.next(ref)){
+        page = ((unsigned long)ref.pid << 48) | (ref.address/SOP);
+        if (sampled){
+            if ((size_t)ref.pid >= sampleLocal.size()) sampleLocal.resize(ref.pid + 1, SampledStackDistance(rate));
+            sampleLocal[ref.pid].access(page);
+            sampleGlobal.access(page);
+        }
+        if (!sampled || compare){
+            if ((size_t)ref.pid >= local.size()) local.resize(ref.pid + 1);
+            local[ref.pid].access(page);
+            global.access(page);
+        }
+    }
+    closeInput(tf);
+    if (!reader.error.empty()){
+        std::cout << reader.error << std::endl;
+        return -1;
+    }
+
+    std::vector<string> scopes;
+    std::vector<double> maxErrors, meanErrors;
+    double maxError, meanError;
+    printf("scope,frames,memory,faults,miss_ratio%s\n", compare ? ",exact_miss_ratio,error" : "");
+    int count = sampled ? sampleLocal.size() : local.size();
+    for (int i = -1; i < count; i++){
+        string scope = i < 0 ? "global" : "process " + to_string(i);
+        unsigned long references = i < 0 ? (sampled ? sampleGlobal.references : global.references)
+                                         : (sampled ? sampleLocal[i].references : local[i].references);
+        if (references == 0) continue;
+        StackDistance* exact = compare ? (i < 0 ? &global : &local[i]) : NULL;
+        if (sampled) printCurve(scope, i < 0 ? sampleGlobal.curve() : sampleLocal[i].curve(), SOP, exact, maxError, meanError);
+        else printCurve(scope, exactCurve(i < 0 ? global : local[i]), SOP, exact, maxError, meanError);
+        scopes.push_back(scope);
+        maxErrors.push_back(maxError);
+        meanErrors.push_back(meanError);
+    }
+
+    // Error bounds of the sampled curves against the exact ones
+    if (compare){
+        printf("\nscope,max_abs_error,mean_abs_error\n");
+        for (size_t i = 0; i < scopes.size(); i++) printf("%s,%.6f,%.6f\n", scopes[i].c_str(), maxErrors[i], meanErrors[i]);
+    }
+    return 0;
+}
+
+// Faults over one window of references, for the fault rate time series
+struct Window{
+    unsigned long end;          // References simulated by the end of the window
+    unsigned long references;
+    unsigned long faults;
+};
+
+void printWindowHeader(Format format){
+    if (format == CSV) printf("end,references,faults,fault_rate\n");
+    else if (format == TEXT) printf("%12s %12s %12s %11s\n", "End", "References", "Faults", "Fault Rate");
+}
+
+// Prints one window. In JSON it's an object, wrapped as {"window": ...} on its own line when printed as the run goes.
+void printWindow(Format format, const Window& window, bool live){
+    double rate = rateOf(window.faults, window.references);
+    if (format == CSV) printf("%lu,%lu,%lu,%.6f\n", window.end, window.references, window.faults, rate);
+    else if (format == JSON){
+        printf("%s{\"end\": %lu, \"references\": %lu, \"faults\": %lu, \"fault_rate\": %.6f}%s", live ? "{\"window\": " : "",
+               window.end, window.references, window.faults, rate, live ? "}\n" : "");
+    }else printf("%12lu %12lu %12lu %11.6f\n", window.end, window.references, window.faults, rate);
+}
+
+// Prints the counts of a finished run: totals and each process, the TLB if it was modelled, and the windows if they
+// weren't already printed as the run went
+void printReport(Format format, Simulation* sim, const std::vector<Window>& windows, bool live){
+    std::vector<ProcessStats> stats = sim->processStats();
+    ProcessStats total = {-1, 0, 0, 0, 0, 0, PrefetchStats()};
+    for (size_t i = 0; i < stats.size(); i++){
+        total.references += stats[i].references;
+        total.hits += stats[i].hits;
+        total.faults += stats[i].faults;
+        total.evictions += stats[i].evictions;
+        total.frames += stats[i].frames;
+        total.prefetches.issued += stats[i].prefetches.issued;
+        total.prefetches.useful += stats[i].prefetches.useful;
+        total.prefetches.wasted += stats[i].prefetches.wasted;
+    }
+    stats.insert(stats.begin(), total);
+    TranslationStats t = sim->translation();
+    bool tlb = TLB_ENTRIES > 0;
+    bool series = !live && windows.size() > 0;
+
+    if (format == CSV){
+        printf("scope,references,hits,faults,evictions,frames,prefetched,useful,wasted,fault_rate\n");
+        for (size_t i = 0; i < stats.size(); i++){
+            string scope = i == 0 ? "global" : "process " + to_string(stats[i].id);
+            printf("%s,%lu,%lu,%lu,%lu,%d,%lu,%lu,%lu,%.6f\n", scope.c_str(), stats[i].references, stats[i].hits, stats[i].faults, stats[i].evictions,
+                   stats[i].frames, stats[i].prefetches.issued, stats[i].prefetches.useful, stats[i].prefetches.wasted,
+                   rateOf(stats[i].faults, stats[i].references));
+        }
+        if (tlb){
+            printf("\ntlb_lookups,tlb_hits,page_walks,levels_read,cycles_per_reference\n");
+            printf("%lu,%lu,%lu,%lu,%.2f\n", t.lookups, t.hits, t.walks, t.levels, t.lookups > 0 ? translationCycles(t, total.faults)/t.lookups : 0.0);
+        }
+        if (series){
+            printf("\n");
+            printWindowHeader(format);
+            for (size_t i = 0; i < windows.size(); i++) printWindow(format, windows[i], false);
+        }
+    }else if (format == JSON){
+        printf("{\"references\": %lu, \"faults\": %lu, \"fault_rate\": %.6f,\n \"processes\": [", total.references, total.faults,
+               rateOf(total.faults, total.references));
+        for (size_t i = 1; i < stats.size(); i++){
+            printf("%s\n  {\"pid\": %d, \"references\": %lu, \"hits\": %lu, \"faults\": %lu, \"evictions\": %lu, \"frames\": %d, "
+                   "\"prefetched\": %lu, \"useful\": %lu, \"wasted\": %lu}", i > 1 ? "," : "", stats[i].id, stats[i].references, stats[i].hits,
+                   stats[i].faults, stats[i].evictions, stats[i].frames, stats[i].prefetches.issued, stats[i].prefetches.useful,
+                   stats[i].prefetches.wasted);
+        }
+        printf("]");
+        if (tlb){
+            printf(",\n \"tlb\": {\"lookups\": %lu, \"hits\": %lu, \"page_walks\": %lu, \"levels_read\": %lu, \"cycles_per_reference\": %.2f}",
+                   t.lookups, t.hits, t.walks, t.levels, t.lookups > 0 ? translationCycles(t, total.faults)/t.lookups : 0.0);
+        }
+        if (series){
+            printf(",\n \"windows\": [");
+            for (size_t i = 0; i < windows.size(); i++){
+                printf("%s\n  ", i > 0 ? "," : "");
+                printWindow(format, windows[i], false);
+            }
+            printf("]");
+        }
+        printf("}\n");
+    }else{
+        printf("References: %lu\nPage Faults: %lu\nFault Rate: %.6f\n", total.references, total.faults, rateOf(total.faults, total.references));
+        printf("%8s %12s %12s %12s %12s %8s %11s %11s %11s\n", "Process", "References", "Hits", "Faults", "Evictions", "Frames",
+               "Prefetched", "Useful", "Wasted");
+        for (size_t i = 1; i < stats.size(); i++){
+            printf("%8d %12lu %12lu %12lu %12lu %8d %11lu %11lu %11lu\n", stats[i].id, stats[i].references, stats[i].hits, stats[i].faults,
+                   stats[i].evictions, stats[i].frames, stats[i].prefetches.issued, stats[i].prefetches.useful, stats[i].prefetches.wasted);
+        }
+        if (tlb){
+            printf("TLB Hits: %lu Page Walks: %lu Hit Rate: %.2f%% Cycles/Reference: %.2f\n", t.hits, t.walks, 100.0*rateOf(t.hits, t.lookups),
+                   t.lookups > 0 ? translationCycles(t, total.faults)/t.lookups : 0.0);
+        }
+        if (series){
+            printWindowHeader(format);
+            for (size_t i = 0; i < windows.size(); i++) printWindow(format, windows[i], false);
+        }
+    }
+}
+
+// Options given as "-name value" anywhere on the command line, e.g. -depth 8
+std::map<string, string> OPTIONS;
+
+// Takes the options out of the arguments and returns the positional ones. Options start with a letter, so a lone '-' (pre-paging off)
+// and lists like -,+ stay positional.
+std::vector<string> parseArgs(int argc, char* argv[]){
+    std::vector<string> args;
+    for (int i = 0; i < argc; i++){
+        string arg = argv[i];
+        if (arg.size() > 1 && arg[0] == '-' && isalpha(arg[1])){
+            if (arg == "-compare" || arg == "-live") OPTIONS[arg] = "1";     // Flags without a value
+            else if (i + 1 < argc) OPTIONS[arg] = argv[++i];
+        }else args.push_back(arg);
+    }
+    return args;
+}
+
+int main(int argc, char* argv[]){
+    std::vector<string> args = parseArgs(argc, argv);
+    if (OPTIONS.count("-depth")) PREFETCH_DEPTH = std::max(1, atoi(OPTIONS["-depth"].c_str()));
+    if (OPTIONS.count("-alloc")){
+        string alloc = OPTIONS["-alloc"];
+        if (alloc == "local") ALLOCATION = LOCAL;
+        else if (alloc == "global") ALLOCATION = GLOBAL;
+        else if (alloc == "ws") ALLOCATION = WORKING_SET;
+        else if (alloc == "pff") ALLOCATION = FAULT_FREQUENCY;
+        else {
+            std::cout << "Unknown allocation: " << alloc << " (local, global, ws, or pff)" << std::endl;
+            return -1;
+        }
+    }
+    if (OPTIONS.count("-tlb")){
+        // Given as ENTRIES or ENTRIES,WAYS
+        std::vector<string> tlb = splitList(OPTIONS["-tlb"]);
+        if (tlb.size() > 0) TLB_ENTRIES = std::max(0, atoi(tlb[0].c_str()));
+        if (tlb.size() > 1) TLB_WAYS = std::max(1, atoi(tlb[1].c_str()));
+    }
+    if (OPTIONS.count("-walk")) WALK_BITS = std::max(1, atoi(OPTIONS["-walk"].c_str()));
+    if (OPTIONS.count("-cycles")){
+        // Given as TLB,WALK,FAULT
+        std::vector<string> cycles = splitList(OPTIONS["-cycles"]);
+        if (cycles.size() == 3){
+            TLB_CYCLES = atoi(cycles[0].c_str());
+            WALK_CYCLES = atoi(cycles[1].c_str());
+            FAULT_CYCLES = atoi(cycles[2].c_str());
+        }
+    }
+    if (OPTIONS.count("-window")) WS_WINDOW = std::max(1, atoi(OPTIONS["-window"].c_str()));
+    if (OPTIONS.count("-pff")){
+        // Given as LOW,HIGH
+        std::vector<string> bounds = splitList(OPTIONS["-pff"]);
+        if (bounds.size() == 2){
+            PFF_LOW = std::max(0, atoi(bounds[0].c_str()));
+            PFF_HIGH = std::max(PFF_LOW, atoi(bounds[1].c_str()));
+        }
+    }
+
+    // Output format for classic mode and sweep
+    Format format = TEXT;
+    if (OPTIONS.count("-format") && OPTIONS["-format"] == "csv") format = CSV;
+    else if (OPTIONS.count("-format") && OPTIONS["-format"] == "json") format = JSON;
+    unsigned long interval = OPTIONS.count("-interval") ? strtoul(OPTIONS["-interval"].c_str(), NULL, 10) : 0;     // References per window
+    bool live = OPTIONS.count("-live");         // Print each window as soon as it's done
+
+    // Threads simulating the programs of one run side by side, under local allocation
+    int threads = OPTIONS.count("-threads") ? std::max(1, atoi(OPTIONS["-threads"].c_str())) : 1;
+
+    // Converting a text trace into the binary format
+    if (args.size() == 5 && args[1] == "convert") return convert(args[2], args[3], args[4]);
+
+    // Writing a synthetic trace
+    if (args.size() == 7 && args[1] == "generate"){
+        // Sizes given as N or MIN,MAX
+        std::vector<string> sizes = splitList(OPTIONS.count("-size") ? OPTIONS["-size"] : "100,1000");
+        unsigned long minSize = sizes.size() > 0 ? strtoul(sizes[0].c_str(), NULL, 10) : 0;
+        unsigned long maxSize = sizes.size() > 1 ? strtoul(sizes[1].c_str(), NULL, 10) : minSize;
+        if (OPTIONS.count("-zipf")) ZIPF_EXPONENT = atof(OPTIONS["-zipf"].c_str());
+        if (OPTIONS.count("-loop")) LOOP_LENGTH = strtoul(OPTIONS["-loop"].c_str(), NULL, 10);
+        if (OPTIONS.count("-stride")) STRIDE = std::max(1UL, strtoul(OPTIONS["-stride"].c_str(), NULL, 10));
+        if (OPTIONS.count("-phase")) PHASE_LENGTH = std::max(1UL, strtoul(OPTIONS["-phase"].c_str(), NULL, 10));
+        unsigned long seed = OPTIONS.count("-seed") ? strtoul(OPTIONS["-seed"].c_str(), NULL, 10) : 1;
+        bool binary = OPTIONS.count("-format") && OPTIONS["-format"] == "binary";
+        return generate(args[2], args[3], atoi(args[4].c_str()), strtoul(args[5].c_str(), NULL, 10), args[6], minSize, maxSize, seed, binary);
+    }
+
+    // Simulating a list of configurations in one pass over the trace
+    if ((args.size() == 7 || args.size() == 8) && args[1] == "sweep"){
+        int threads = args.size() == 8 ? atoi(args[7].c_str()) : sysconf(_SC_NPROCESSORS_ONLN);
+        if (threads < 1) threads = 1;
+        return sweep(args[2], args[3], args[4], args[5], args[6], threads, format);
+    }
+
+    // Timing the reference loop of each configuration
+    if ((args.size() == 7 || args.size() == 8) && args[1] == "bench"){
+        int repeat = args.size() == 8 ? atoi(args[7].c_str()) : 3;
+        if (repeat < 1) repeat = 1;
+        return bench(args[2], args[3], args[4], args[5], args[6], repeat, threads);
+    }
+
+    // Fixed benchmark suite, optionally saved as or compared against a JSON baseline
+    if (args.size() == 2 && args[1] == "suite"){
+        unsigned long references = OPTIONS.count("-refs") ? strtoul(OPTIONS["-refs"].c_str(), NULL, 10) : 1000000;
+        int repeat = OPTIONS.count("-repeat") ? std::max(1, atoi(OPTIONS["-repeat"].c_str())) : 3;
+        double tolerance = OPTIONS.count("-tolerance") ? atof(OPTIONS["-tolerance"].c_str()) : 0.1;
+        if (OPTIONS.count("-write")) return writeSuite(OPTIONS["-write"], references);
+        return suite(references, repeat, OPTIONS.count("-json") ? OPTIONS["-json"] : "", OPTIONS.count("-baseline") ? OPTIONS["-baseline"] : "",
+                     tolerance);
+    }
+
+    // LRU faults for every memory size in one pass over the trace
+    if (args.size() == 5 && args[1] == "mrc"){
+        double rate = OPTIONS.count("-sample") ? atof(OPTIONS["-sample"].c_str()) : 1;     // Fraction of pages sampled
+        bool compare = OPTIONS.count("-compare");       // Also run the exact computation and report the sampling error
+        if (rate <= 0 || rate > 1) rate = 1;
+        return missRatioCurve(args[2], args[3], atoi(args[4].c_str()), rate, compare);
+    }
+
+    // Ensuring the correct amount of parameters
+    if (args.size() != 6) {
+        std::cout << "Usage ./assign2 plist ptrace P1 P2 P3 [-depth N] [-alloc A] [-window N] [-pff LOW,HIGH]\n"
+                  << "P1: Size of pages/# of memory locations per page\n"
+                  << "P2: Type of page replacement algo (FIFO, LRU, Clock, OPT, ARC, CAR, 2Q, or CLOCK-Pro)\n"
+                  << "P3: Turn on or off pre-paging ('+' for on, '-' for off)\n"
+                  << "-depth N: most pages pre-paging brings in on one fault (default 8), for every mode\n"
+                  << "-alloc A: how frames are shared, for every mode: local (fixed equal shares, default), global (one policy over all pages),\n"
+                  << "   ws (shares follow each process's working set over its last -window N references, default 1000, and processes are\n"
+                  << "   swapped out while the working sets don't all fit),\n"
+                  << "   or pff (a share grows on faults less than LOW references apart and shrinks after HIGH without one, -pff LOW,HIGH, default 5,50)\n"
+                  << "-tlb E[,W]: model a TLB of E entries, W to a set (default 4), in front of the page tables, for classic mode and sweep.\n"
+                  << "   -walk B sets the page number bits per page table level (default 9), and -cycles T,W,F the cost of a TLB lookup,\n"
+                  << "   of reading one level on a miss and of a fault (default 1,25,100000) used for the cycles per reference\n"
+                  << "-threads N: simulate the processes on N threads (local allocation), here and in bench\n"
+                  << "-format F: report as text (default), csv or json, here and in sweep. Prints totals and each process's faults, hits and evictions.\n"
+                  << "-interval N: also report the fault rate of every N references, -live prints each window as soon as it's done\n"
+                  << "ptrace may be a text trace or a binary trace. For a binary trace, plist may be '-' to use the trace's process list.\n"
+                  << "ptrace may be '-' for standard input or a named pipe, and gzip or zstd compressed. It's read a chunk at a time,\n"
+                  << "so memory doesn't grow with the length of the trace, except for OPT which reads it all first.\n"
+                  << "Usage ./assign2 convert plist ptrace output\n"
+                  << "Converts a text plist and ptrace into a binary trace\n"
+                  << "Usage ./assign2 generate plist ptrace PROCESSES REFERENCES PATTERN [-size N|MIN,MAX] [-seed S] [-format text|binary]\n"
+                  << "Writes a synthetic trace. PATTERN is uniform, zipf [-zipf S], loop [-loop N], stride [-stride N], phase [-phase N], or mix.\n"
+                  << "ptrace may be '-' to stream the trace to standard output. plist may be '-' to print the process list instead,\n"
+                  << "or with -format binary to leave it out since the trace carries it\n"
+                  << "Usage ./assign2 sweep plist ptrace P1,... P2,... P3,... [threads]\n"
+                  << "Simulates every combination of the listed values in one pass, e.g. sweep plist ptrace 1,2,4,8,16 FIFO,LRU,Clock +,-\n"
+                  << "Usage ./assign2 bench plist ptrace P1,... P2,... P3,... [repeat] [-threads N]\n"
+                  << "Times the simulation of each combination and prints references per second, use -threads N to split up the processes\n"
+                  << "Usage ./assign2 suite [-refs N] [-repeat N] [-json out.json] [-baseline base.json] [-tolerance T] [-write DIR]\n"
+                  << "Times FIFO, LRU and Clock on fixed synthetic traces over process counts, page sizes and locality, and PhysicalMemory::swapIn\n"
+                  << "alone. -json saves a baseline, -baseline compares against one and fails on cases more than T (default 0.1) slower.\n"
+                  << "-write saves the suite's traces to DIR instead, for timing other builds such as assign2_alt on the same references\n"
+                  << "Allocations per fault are only counted in a build with -DCOUNT_ALLOCATIONS\n"
+                  << "Usage ./assign2 mrc plist ptrace P1 [-sample R] [-compare]\n"
+                  << "Prints LRU faults and miss ratio for every memory size, globally and for each process, as CSV\n"
+                  << "-sample R estimates the curves from a fraction R of the pages, -compare reports the error against the exact curves" << std::endl;
+        return -1;
+    }
+
+    // Input values
+    string plist = args[1];              // Plist file
+    string ptrace = args[2];             // Ptrace file
+    int SOP = atoi(args[3].c_str());     // Size of pages
+    string algo = args[4];               // Algorithm: FIFO, LRU, Clock, ...
+    string pre_paging = args[5];         // Pre-paging: + for on, - for off
+
+    // Opening the trace first since a binary trace carries its own process list
+    FILE* tf = openInput(ptrace);
+    if (tf == NULL){
+        std::cout << "Could not open " << ptrace << std::endl;
+        return -1;
+    }
+    TraceReader trace(tf);
+    std::vector<Process> processes;
+    if (!loadProcesses(plist, trace, processes)){
+        closeInput(tf);
+        return -1;
+    }
+
+    // OPT looks ahead, so it gets the whole trace read in first. Otherwise the trace is simulated a chunk at a time,
+    // one window of the fault rate series per chunk when -interval is given.
+    bool offline = algo == OPTPolicy::name();
+    std::vector<Reference> buffered;
+    Reference ref;
+    if (offline) while (trace.next(ref)) buffered.push_back(ref);
+
+    // Setting up the page tables
+    Simulation* sim = makeSimulation(processes, SOP, algo, pre_paging, offline ? &buffered : NULL);
+    if (sim == NULL){
+        closeInput(tf);
+        return -1;
+    }
+
+    std::vector<Window> windows;
+    size_t chunk = interval > 0 ? interval : 65536;
+    size_t index = 0;
+    unsigned long simulated = 0;
+    if (live && interval > 0) printWindowHeader(format);
+    while (true){
+        const Reference* refs;
+        size_t count;
+        if (offline){
+            refs = buffered.data() + index;
+            count = std::min(chunk, buffered.size() - index);
+            index += count;
+        }else{
+            buffered.clear();
+            while (buffered.size() < chunk && trace.next(ref)) buffered.push_back(ref);
+            refs = buffered.data();
+            count = buffered.size();
+        }
+        if (count == 0) break;
+
+        unsigned long before = sim->faults();
+        if (DEBUG) for (size_t i = 0; i < count; i++) sim->reference(refs[i]);
+        else sim->runParallel(refs, count, threads);
+        simulated += count;
+        if (interval > 0){
+            Window window = {simulated, count, sim->faults() - before};
+            if (live){
+                printWindow(format, window, true);
+                fflush(stdout);
+            }else windows.push_back(window);
+        }
+    }
+    closeInput(tf);
+    if (!trace.error.empty()){
+        std::cout << trace.error << std::endl;
+        delete sim;
+        return -1;
     }
 
-    //Output data to file
-    // cout << "Total Page Faults: " << PSCOUNT << endl;
-    char str[2];
-    fgets(str, 2, stdin);
+    if (DEBUG) sim->print();
+    if (live && interval > 0 && format != JSON) printf("\n");
+    printReport(format, sim, windows, live);
+    delete sim;
 
     return 0;
 }
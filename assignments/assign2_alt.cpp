@@ -8,6 +8,10 @@
 #include <time.h>
 #include <vector>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <stdio.h>
 using namespace std;
 
 //If this value is true, all debug statements are printed.
@@ -20,6 +24,41 @@ unsigned long PSCOUNT = 0;  // Increments when pages are swapped
 unsigned long PCOUNT = 0;   // Increments when a virtual page is created
 int MEMSIZE = 512;          // The maximum size of memory
 
+// Heap allocations so far, for bench's allocations per fault. Counting them replaces the global operator new, so it's only
+// built in with -DCOUNT_ALLOCATIONS, and bench shows "-" otherwise.
+std::atomic<unsigned long> ALLOCATIONS(0);
+
+#ifdef COUNT_ALLOCATIONS
+const bool COUNTING_ALLOCATIONS = true;
+
+void* operator new(size_t size){
+    ALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size > 0 ? size : 1);
+    if (p == NULL) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept{
+    ALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size > 0 ? size : 1);
+}
+
+// Out of line so the compiler doesn't see free() meeting memory from operator new and warn about a mismatch
+__attribute__((noinline)) void operator delete(void* p) noexcept{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, const std::nothrow_t&) noexcept{
+    free(p);
+}
+#else
+const bool COUNTING_ALLOCATIONS = false;
+#endif
+
 // Page table for each program, a vector of arrays (size 3), where each vector index is a page.
 // 1st array index is the page number (unique among all pages in all tables). We can use  the vector index to find the local page number for each program's page table
 // 2nd array index is the valid bit, 0 if not in memory, 1 if in memory
@@ -196,13 +235,155 @@ class PageTable{
         }
 };
 
+// Reads "first second" number pairs from name + ".txt", used for both the plist and the ptrace
+std::vector<std::array<int, 2>> readPairs(string name){
+    std::vector<std::array<int, 2>> pairs;
+    std::ifstream i(name + ".txt");
+    std::string in;
+    if (i.is_open()){
+        while (getline(i, in)){
+            std::stringstream ss(in);
+            std::array<int, 2> pair = {0, 0};
+            int chk = 0;
+            while (getline(ss, in, ' ') && chk < 2){
+                pair[chk++] = std::stoi(in);
+            }
+            if (chk == 2) pairs.push_back(pair);
+        }
+    }
+    i.close();
+    return pairs;
+}
+
+// Runs the given trace and returns the number of page faults
+unsigned long simulate(const std::vector<std::array<int, 2>>& plist, const std::vector<std::array<int, 2>>& ptrace, int sop, string algo, string pre_paging){
+    RCOUNT = 0;
+    VCOUNT = 1;
+    PSCOUNT = 0;
+    PCOUNT = 0;
+
+    // Setting up the page tables
+    std::vector<PageTable> programs;
+    int program_id, total_pages;
+    for (size_t i = 0; i < plist.size(); i++){
+        program_id = plist[i][0];
+        if (DEBUG) std::cout << float(plist[i][1])/float(sop) << std::endl;
+        total_pages = ceil(float(plist[i][1])/float(sop));
+        if (DEBUG) std::cout << program_id << " " << total_pages << std::endl;
+        programs.push_back(PageTable(program_id, total_pages));
+    }
+
+    // Default loading of memory
+    // Dividing the total memory by size of pages to get how many pages can fit in memory. 
+    // Divide that by number of programs to find how many pages each program is allocated.
+    // As a check, sop = 2 -> page per program = 25, sop = 4 -> page per program = 12, sop = 8 -> page per program = 6, etc.
+    
+    int mem_space = (MEMSIZE/sop)/programs.size(); 
+    if (DEBUG) cout << "Pages per program: " << mem_space << endl;
+
+    for (size_t i = 0; i < programs.size(); i++){
+        programs[i].setup(mem_space);
+    }
+
+    // Copy and paste this to print page table to check values at a certain point (It'll be really long if size of page is small)
+    if (DEBUG) {
+        for (size_t i = 0; i < programs.size(); i++){
+            programs[i].print();
+        }
+    }
+    
+    // Going through ptrace and performing swaps as necessary
+    int memory_ref;
+    for (size_t i = 0; i < ptrace.size(); i++){
+        program_id = ptrace[i][0];
+        if (DEBUG) cout << program_id << " " << ptrace[i][1] << endl;
+        memory_ref = float(ptrace[i][1])/float(sop);
+        // Increment the reference count for each line
+        ++RCOUNT;
+        if (DEBUG) cout << program_id << " " << memory_ref << endl;
+        //Swap if page isn't in main memory and increment page swap counter
+        if (!programs[program_id].checkMain(memory_ref, algo)){
+            programs[program_id].pageSwap(memory_ref, algo, pre_paging, memory_ref);
+            ++PSCOUNT;
+            if(DEBUG) programs[program_id].print();
+            if(DEBUG) cout << "Page Swaps: " << PSCOUNT << endl;
+            
+        }
+    }
+    if (DEBUG) cout << "RCOUNT: " << RCOUNT << endl;
+    return PSCOUNT;
+}
+
+// Times each algorithm over a trace with the same measures as assign2's suite: references per second, nanoseconds per fault
+// (run time over faults) and, with -DCOUNT_ALLOCATIONS, allocations per fault. The trace is read in first so only the simulation is timed, and the fastest of
+// repeat runs is kept. Given the traces written by "assign2 suite -write", cases get the same names as in assign2's suite,
+// and with an output file they are saved in its JSON format so the two designs can be compared case by case.
+int bench(string plist, string ptrace, int sop, string algos, string pre_paging, int repeat, string output){
+    std::vector<std::array<int, 2>> processes = readPairs(plist), trace = readPairs(ptrace);
+    if (processes.size() == 0){
+        cout << "Could not read " << plist << ".txt" << endl;
+        return -1;
+    }
+
+    // Cases are named after the plist, without its _plist suffix
+    string base = plist.substr(plist.find_last_of('/') + 1);
+    if (base.size() > 6 && base.compare(base.size() - 6, 6, "_plist") == 0) base = base.substr(0, base.size() - 6);
+
+    FILE* out = output.length() != 0 ? fopen(output.c_str(), "w") : NULL;
+    if (out != NULL) fprintf(out, "{\"cases\": [");
+    printf("%-24s %8s %14s %10s %12s\n", "Case", "Hit %", "References/s", "ns/fault", "allocs/fault");
+    std::stringstream list(algos);
+    string algo;
+    int count = 0;
+    while (getline(list, algo, ',')){
+        double best = 0;
+        unsigned long faults = 0, allocations = 0;
+        for (int r = 0; r < repeat; r++){
+            unsigned long before = ALLOCATIONS.load();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            faults = simulate(processes, trace, sop, algo, pre_paging);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            allocations = ALLOCATIONS.load() - before;
+            if (r == 0 || seconds < best) best = seconds;
+        }
+        string name = base + "_s" + to_string(sop) + "_" + algo;
+        double hits = trace.size() > 0 ? 1 - double(faults)/trace.size() : 0;
+        double rate = best > 0 ? trace.size()/best : 0;
+        double perFault = faults > 0 ? best*1e9/faults : 0;
+        char allocsPerFault[32] = "-";
+        if (COUNTING_ALLOCATIONS) snprintf(allocsPerFault, sizeof(allocsPerFault), "%.4f", faults > 0 ? double(allocations)/faults : 0);
+        printf("%-24s %8.2f %14.0f %10.2f %12s\n", name.c_str(), 100*hits, rate, perFault, allocsPerFault);
+        if (out != NULL){
+            fprintf(out, "%s\n  {\"case\": \"%s\", \"page_size\": %d, \"algorithm\": \"%s\", \"references\": %lu, \"faults\": %lu, "
+                    "\"hit_ratio\": %.6f, \"refs_per_sec\": %.0f, \"ns_per_fault\": %.2f, \"allocs_per_fault\": %s}", count > 0 ? "," : "",
+                    name.c_str(), sop, algo.c_str(), (unsigned long)trace.size(), faults, hits, rate, perFault,
+                    COUNTING_ALLOCATIONS ? allocsPerFault : "null");
+        }
+        ++count;
+    }
+    if (out != NULL){
+        fprintf(out, "]}\n");
+        fclose(out);
+    }
+    return 0;
+}
+
 int main(int argc, char* argv[]){
+    // Timing the simulation
+    if ((argc == 7 || argc == 8 || argc == 9) && string(argv[1]) == "bench"){
+        int repeat = argc >= 8 ? atoi(argv[7]) : 3;
+        if (repeat < 1) repeat = 1;
+        return bench(argv[2], argv[3], atoi(argv[4]), argv[5], argv[6], repeat, argc == 9 ? argv[8] : "");
+    }
+
     // Ensuring the correct amount of parameters
     if (argc != 6) {
         std::cout << "Usage ./assign2 plist ptrace P1 P2 P3\n"
                   << "P1: Size of pages/# of memory locations per page\n"
                   << "P2: Type of page replacement algo (FIFO, LRU, or Clock)\n"
-                  << "P3: Turn on or off pre-paging ('+' for on, '-' for off)" << std::endl;
+                  << "P3: Turn on or off pre-paging ('+' for on, '-' for off)\n"
+                  << "Usage ./assign2 bench plist ptrace P1 P2,... P3 [repeat] [output.json]\n"
+                  << "Times each listed algorithm and prints references per second, ns per fault and, with -DCOUNT_ALLOCATIONS, allocations per fault" << std::endl;
         return -1;
     }
 
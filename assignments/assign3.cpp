@@ -1,5 +1,7 @@
 #include <iostream>
 #include <list>
+#include <set>
+#include <algorithm>
 #include <stdlib.h>
 #include <string.h>
 #include <vector>
@@ -9,364 +11,1171 @@
 #include <ctime>
 #include <sstream>
 #include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string_view>
+#include <charconv>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 // Global Variables
 int BLOCKSIZE;          // Size of the block in the system
 
 bool DEBUG = false;      // If on, prints debug statements
 
+// Where new blocks are placed, picked with -fit. SCATTER fills the lowest free blocks even when that splits a file; the others
+// look for one free run that holds the whole request and only scatter when there is none. ALIGNED places a file at the
+// start of a free power-of-two block aligned to its size, the way a buddy allocator would, but keeps no block orders.
+enum Fit { SCATTER, FIRST_FIT, NEXT_FIT, BEST_FIT, ALIGNED };
+const char* FIT_NAMES[] = {"scatter", "first", "next", "best", "aligned"};
+Fit FIT = SCATTER;
+
+// A contiguous run of blocks, from start up to start+length-1
+struct Extent{
+    int start;
+    int length;
+
+    Extent(int start, int length) : start(start), length(length){}
+
+    // One past the last block of the run
+    int end() const{
+        return start + length;
+    }
+};
+
+// Disk block allocator. The backend is picked at startup with -disk, the placement strategy with -fit.
 class Ldisk{
-    private:
-        // Node that saves disk nodes
-        class LdiskNode{
-            public:
-                bool free;          // Determines if the node is free or not.
-                std::vector<int> block_set;
-
-                // Generates vector based on first element and size
-                std::vector<int> genVector(int first, int size){
-                    std::vector<int> result;
-                    result.resize(size);
-                    for(int i = 0; i < size; i++){
-                        result[i] = first + i;
+    public:
+        virtual ~Ldisk(){}
+
+        // Initiates Ldisk. We do this after BLOCKSIZE is set, since the very first node's size will be BLOCKSIZE.
+        virtual void initLdisk(int block_count) = 0;
+
+        // Gets the sum of occupied blocks
+        virtual int sumOccupied() = 0;
+
+        // Gets the sum of free blocks
+        virtual int sumFree() = 0;
+
+        // Gets the number of blocks in the largest free run
+        virtual int largestFree() = 0;
+
+        // Gets the number of free runs
+        virtual int freeExtents() = 0;
+
+        // Prints out disk footprint without disk fragmentation. Fragmentation is calculated by the tree.
+        virtual void diskFootprint() = 0;
+
+        // Frees every run of blocks in the given list
+        virtual void free(const std::vector<Extent>& released) = 0;
+
+        // Appends the runs in use, in block order
+        virtual void usedExtents(std::vector<Extent>& runs) = 0;
+
+        // Where the next-fit search resumes, saved with snapshots
+        int nextFit(){
+            return next_fit;
+        }
+
+        // Resets the disk to block_count blocks with the given runs in use, as saved in a snapshot
+        void restore(int block_count, const Extent* runs, size_t count, int next){
+            initLdisk(block_count);
+            for(size_t i = 0; i < count; i++) take(runs[i].start, runs[i].length);
+            next_fit = next;
+        }
+
+        // Share of free space outside the largest free run: 0 when all free blocks are contiguous, near 1 when scattered
+        double externalFragmentation(){
+            int free_blocks = sumFree();
+            return free_blocks > 0 ? 1.0 - double(largestFree())/free_blocks : 0.0;
+        }
+
+        // Allocate free blocks with the current strategy then returns the runs of all the filled blocks
+        std::vector<Extent> allocate(int size){
+            std::vector<Extent> extents;    // The newly allocated runs
+            if(size > sumFree()){
+                std::cout << "NOT ENOUGH SPACE TO GROW OR ADD FILE." << std::endl;
+                return extents;
+            }
+            int start, length;
+            bool placed = false;
+            if(FIT == FIRST_FIT) placed = findRun(size, 0, start, length);
+            else if(FIT == NEXT_FIT) placed = findRun(size, next_fit, start, length) || findRun(size, 0, start, length);
+            else if(FIT == BEST_FIT) placed = findBest(size, start, length);
+            else if(FIT == ALIGNED) placed = findAligned(size, start);
+            if(placed){
+                take(start, size);
+                extents.push_back(Extent(start, size));
+                next_fit = start + size;
+                return extents;
+            }
+            // Loops until all memory has been allocated to some free block, lowest blocks first.
+            int from = 0;
+            while(size > 0 && findRun(1, from, start, length)){
+                int taken = std::min(size, length);
+                take(start, taken);
+                extents.push_back(Extent(start, taken));
+                size -= taken;
+                from = start + taken;
+            }
+            next_fit = from;
+            return extents;
+        }
+
+        // Allocates blocks for several files in order, with the same result as calling allocate for each. Under the scatter
+        // strategy one cursor walks the free runs and touching pieces are marked together, so a load onto an empty disk
+        // marks a single run.
+        std::vector<std::vector<Extent> > allocateBatch(const std::vector<int>& sizes){
+            std::vector<std::vector<Extent> > extents(sizes.size());
+            if(FIT != SCATTER){
+                for(size_t i = 0; i < sizes.size(); i++){
+                    if(sizes[i] > 0) extents[i] = allocate(sizes[i]);
+                }
+                return extents;
+            }
+            int remaining = sumFree();                  // Free blocks once the pending span is marked
+            int run_start = 0, run_length = 0;          // Rest of the free run under the cursor
+            int span_start = 0, span_length = 0;        // Blocks handed out but not marked yet
+            for(size_t i = 0; i < sizes.size(); i++){
+                int size = sizes[i];
+                if(size <= 0) continue;
+                if(size > remaining){
+                    std::cout << "NOT ENOUGH SPACE TO GROW OR ADD FILE." << std::endl;
+                    continue;
+                }
+                remaining -= size;
+                while(size > 0){
+                    if(run_length == 0){
+                        if(span_length > 0) take(span_start, span_length);
+                        findRun(1, run_start, run_start, run_length);
+                        span_start = run_start;
+                        span_length = 0;
                     }
-                    return result;
+                    int taken = std::min(size, run_length);
+                    extents[i].push_back(Extent(run_start, taken));
+                    run_start += taken;
+                    run_length -= taken;
+                    span_length += taken;
+                    size -= taken;
                 }
+            }
+            if(span_length > 0){
+                take(span_start, span_length);
+                next_fit = run_start;
+            }
+            return extents;
+        }
 
-                // Initializes LdiskNode by generating a vector from first to size-1
-                LdiskNode(bool free, int first, int size) : free(free){
-                    block_set = genVector(first, size);
-                }
+    protected:
+        int next_fit = 0;   // Where the next-fit search resumes
 
-                // Prints out LdiskNode in the format specified by PDF
-                void print(){
-                    if(free) std::cout << "Free: ";
-                    else std::cout << "In use: ";
-                    std::cout << block_set.front() << "-" << block_set.back() << std::endl;
-                }
+        // Finds the first free run holding at least size blocks, counting only blocks at or after from. Returns false when
+        // there is none.
+        virtual bool findRun(int size, int from, int& start, int& length) = 0;
 
-                // Appends the given vector to this blockset. Helpful in combining two nodes.
-                void append(std::vector<int> append_set){
-                    block_set.insert(block_set.end(), append_set.begin(), append_set.end());
-                }
+        // Finds the smallest free run holding at least size blocks. Returns false when there is none.
+        virtual bool findBest(int size, int& start, int& length) = 0;
+
+        // Marks a run of free blocks as used
+        virtual void take(int start, int length) = 0;
 
-                // Cuts out size elements from the front and returns it
-                LdiskNode split(int size){
-                    int first_block = block_set[0];                                 // Saves it since block_set will be updated
-                    block_set = genVector(block_set[size], block_set.size()-size);  // Updates current block set to be equal to the second half
-                    return LdiskNode(this->free, first_block, size);                // Returns the second haff
+        // Finds the start of the smallest free power-of-two block, aligned to its size, that holds size blocks. The free runs
+        // are cut into the largest aligned blocks that fit in them, which is where a buddy allocator would place the file.
+        // It isn't one though: there are no per-order free lists or splitting and merging, only the requested blocks are
+        // taken and the rest stays ordinary free space. Returns false when no aligned block is big enough, and allocate
+        // then scatters the file like every other fit.
+        bool findAligned(int size, int& start){
+            int order = 0;      // Smallest power of two holding size blocks
+            while((1LL << order) < size) order++;
+            int best = 64;      // Order of the best block found so far
+            int from = 0, run_start, run_length;
+            while(findRun(1 << order, from, run_start, run_length)){
+                long long block = run_start, end = (long long)run_start + run_length;
+                while(block < end){
+                    int k = block == 0 ? 62 : __builtin_ctzll(block);   // Largest aligned block starting here
+                    while(block + (1LL << k) > end) k--;
+                    if(k >= order && k < best){
+                        best = k;
+                        start = block;
+                        if(k == order) return true;                     // Cannot do better, and this is the lowest one
+                    }
+                    block += 1LL << k;
                 }
+                from = run_start + run_length;
+            }
+            return best < 64;
+        }
 
-                // Cuts out size elements from the back and returns it
-                LdiskNode backSplit(int size){
-                    int second_block = block_set[block_set.size()-size];            // Saves the first block of the second half
-                    block_set = genVector(block_set[0], block_set.size()-size);     // Updates current block set to be equal to the first half
-                    return LdiskNode(this->free, second_block, size);               // Returns the first half
+        // Prints out a run in the format specified by PDF
+        void printExtent(bool free, int start, int length){
+            if(free) std::cout << "Free: ";
+            else std::cout << "In use: ";
+            std::cout << start << "-" << start+length-1 << std::endl;
+        }
+};
+
+// Keeps the free and used runs of blocks as extents in ordered maps
+class ExtentLdisk : public Ldisk{
+    private:
+        typedef std::map<int, int> ExtentMap;       // Maps the first block of a run to its length
+        typedef ExtentMap::iterator EMiter;         // Shortenes the iterator
+
+        ExtentMap free_extents;                     // Free runs ordered by start block
+        ExtentMap used_extents;                     // Runs in use ordered by start block
+        std::set<std::pair<int, int> > free_sizes;  // Free runs ordered by (length, start) so they can be searched by size
+        int free_count = 0;                         // Number of free blocks
+        int used_count = 0;                         // Number of blocks in use
+
+        // Adds a run to the free indexes, merging it with free neighbors on either side
+        void addFree(int start, int length){
+            free_count += length;
+            EMiter next = free_extents.lower_bound(start);
+            if(next != free_extents.begin()){
+                EMiter prev = next;
+                --prev;
+                if(prev->first + prev->second == start){
+                    start = prev->first;
+                    length += prev->second;
+                    free_sizes.erase(std::make_pair(prev->second, prev->first));
+                    free_extents.erase(prev);
                 }
+            }
+            if(next != free_extents.end() && next->first == start + length){
+                length += next->second;
+                free_sizes.erase(std::make_pair(next->second, next->first));
+                free_extents.erase(next);
+            }
+            free_extents[start] = length;
+            free_sizes.insert(std::make_pair(length, start));
+        }
 
-                // Checks if a given block is included in this Node
-                bool blockIncluded(int block){
-                    if(block >= block_set[0] && block <= block_set[block_set.size()-1]){
-                        return true;
-                    }else return false;
+        // Removes a run from the free indexes
+        void removeFree(EMiter it){
+            free_sizes.erase(std::make_pair(it->second, it->first));
+            free_count -= it->second;
+            free_extents.erase(it);
+        }
+
+        // Adds a run to the used index, merging it with used neighbors on either side
+        void addUsed(int start, int length){
+            used_count += length;
+            EMiter next = used_extents.lower_bound(start);
+            if(next != used_extents.begin()){
+                EMiter prev = next;
+                --prev;
+                if(prev->first + prev->second == start){
+                    prev->second += length;
+                    if(next != used_extents.end() && next->first == start + length){
+                        prev->second += next->second;
+                        used_extents.erase(next);
+                    }
+                    return;
                 }
-        };
-        std::list<LdiskNode> nodes;                         // Saves a linked list of all the nodes
-        typedef std::list<LdiskNode>::iterator LDNiter;     // Shortenes the iterator
+            }
+            if(next != used_extents.end() && next->first == start + length){
+                length += next->second;
+                used_extents.erase(next);
+            }
+            used_extents[start] = length;
+        }
+
+        // Removes a run from the used index
+        void removeUsed(EMiter it){
+            used_count -= it->second;
+            used_extents.erase(it);
+        }
+
+        // Finds the run in the given index that includes the given block, or end() if there is none
+        EMiter findNode(ExtentMap& extents, int block){
+            EMiter it = extents.upper_bound(block);
+            if(it == extents.begin()) return extents.end();
+            --it;
+            if(block < it->first + it->second) return it;
+            return extents.end();
+        }
 
     public:
-        // Initiates Ldisk. We do this after BLOCKSIZE is set, since the very first node's size will be BLOCKSIZE.
         void initLdisk(int block_count){
-            nodes.push_front(LdiskNode(true, 0, block_count));
+            free_extents.clear();
+            used_extents.clear();
+            free_sizes.clear();
+            free_count = 0;
+            used_count = 0;
+            next_fit = 0;
+            addFree(0, block_count);
+        }
+
+        void usedExtents(std::vector<Extent>& runs){
+            for(EMiter it = used_extents.begin(); it != used_extents.end(); ++it) runs.push_back(Extent(it->first, it->second));
         }
 
-        // Gets the sum of occupied blocks
         int sumOccupied(){
-            int size = 0;
-            for(LDNiter it=nodes.begin(); it != nodes.end(); ++it){
-                if(!it->free){
-                    size += it->block_set.size();
+            return used_count;
+        }
+
+        int sumFree(){
+            return free_count;
+        }
+
+        void diskFootprint(){
+            EMiter free_it = free_extents.begin();
+            EMiter used_it = used_extents.begin();
+            // Merge the two indexes back into block order
+            while(free_it != free_extents.end() || used_it != used_extents.end()){
+                if(used_it == used_extents.end() || (free_it != free_extents.end() && free_it->first < used_it->first)){
+                    printExtent(true, free_it->first, free_it->second);
+                    ++free_it;
+                }else{
+                    printExtent(false, used_it->first, used_it->second);
+                    ++used_it;
                 }
             }
-            return size;
         }
 
-        // Gets the sum of free blocks
-        int sumFree(){
-            int size = 0;
-            for(LDNiter it=nodes.begin(); it != nodes.end(); ++it){
-                if(it->free){
-                    size += it->block_set.size();
+        int largestFree(){
+            return free_sizes.empty() ? 0 : free_sizes.rbegin()->first;
+        }
+
+        int freeExtents(){
+            return free_extents.size();
+        }
+
+        void free(const std::vector<Extent>& released){
+            for(size_t i = 0; i < released.size(); i++){
+                int first = released[i].start;
+                int last = released[i].end();
+                // The run may cover several used runs, so release it piece by piece
+                while(first < last){
+                    EMiter it = findNode(used_extents, first);
+                    if(it == used_extents.end()) break;
+                    int start = it->first;
+                    int end = it->first + it->second;
+                    int stop = std::min(end, last);
+                    removeUsed(it);
+                    if(start < first) addUsed(start, first - start);   // Part before the freed blocks
+                    if(stop < end) addUsed(stop, end - stop);           // Part after the freed blocks
+                    addFree(first, stop - first);
+                    first = stop;
                 }
             }
-            return size;
         }
 
-        // Prints out disk footprint without disk fragmentation. Fragmentation is calculated by the tree.
-        void diskFootprint(){
-            for(LDNiter it=nodes.begin(); it != nodes.end(); ++it){
-                it->print();
+    protected:
+        bool findRun(int size, int from, int& start, int& length){
+            EMiter it = findNode(free_extents, from);      // A run that starts before from still counts from there
+            if(it == free_extents.end()) it = free_extents.lower_bound(from);
+            for(; it != free_extents.end(); ++it){
+                int first = std::max(it->first, from);
+                if(it->first + it->second - first >= size){
+                    start = first;
+                    length = it->first + it->second - first;
+                    return true;
+                }
             }
+            return false;
         }
 
-        // Finds a node that includes the given block
-        LDNiter findNode(int block){
-            LDNiter it;
-            for(it = nodes.begin(); (!it->blockIncluded(block)) && it != nodes.end(); ++it);
-            return it;
+        bool findBest(int size, int& start, int& length){
+            std::set<std::pair<int, int> >::iterator it = free_sizes.lower_bound(std::make_pair(size, -1));
+            if(it == free_sizes.end()) return false;
+            length = it->first;
+            start = it->second;
+            return true;
         }
 
-        // Gets the first free node and returns an iterator pointing to that node.
-        LDNiter findFree(){
-            LDNiter it;
-            for(it = nodes.begin(); !(it->free) && it != nodes.end(); ++it);
-            return it;
+        void take(int start, int length){
+            EMiter it = findNode(free_extents, start);
+            int first = it->first;
+            int end = it->first + it->second;
+            removeFree(it);
+            if(first < start) addFree(first, start - first);                        // Part before the taken blocks
+            if(start + length < end) addFree(start + length, end - start - length); // Put back what was not needed
+            addUsed(start, length);
         }
+};
 
-        // Splits the node by cutting out size elements from the front. It returns iterator to that first half.
-        LDNiter split(LDNiter it, int size){
-            if(size > 0 && size < it->block_set.size()) {
-                LdiskNode first_half = it->split(size); // Gets the the first half
-                return nodes.insert(it, first_half);
-            }else return it;
+// Index of the first word at or after from that differs from value, or count if there is none.
+// Compares four words per step with AVX2 and two with SSE2.
+size_t firstNotEqual(const uint64_t* words, size_t from, size_t count, uint64_t value){
+    size_t i = from;
+#if defined(__AVX2__)
+    __m256i target = _mm256_set1_epi64x(value);
+    for(; i + 4 <= count; i += 4){
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(words + i));
+        if(_mm256_movemask_epi8(_mm256_cmpeq_epi64(chunk, target)) != -1) break;
+    }
+#elif defined(__SSE2__)
+    __m128i target = _mm_set1_epi64x(value);
+    for(; i + 2 <= count; i += 2){
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(words + i));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi32(chunk, target)) != 0xFFFF) break;
+    }
+#endif
+    for(; i < count && words[i] == value; i++);
+    return i;
+}
+
+// Keeps one bit per block, set while the block is in use. Two summary bitmaps hold one bit per 64-block word: full marks
+// words with every block in use and empty marks words with every block free, so searches skip whole words at a time.
+class BitmapLdisk : public Ldisk{
+    private:
+        std::vector<uint64_t> bits;     // One bit per block, set when the block is in use
+        std::vector<uint64_t> full;     // One bit per word of bits, set when the word has no free block
+        std::vector<uint64_t> empty;    // One bit per word of bits, set when the word has no used block
+        int block_count = 0;            // Number of blocks on the disk
+        int used_count = 0;             // Number of blocks in use
+
+        // Refreshes the summary bits of one word
+        void updateSummary(size_t word){
+            uint64_t bit = 1ULL << (word & 63);
+            if(bits[word] == ~0ULL) full[word >> 6] |= bit;
+            else full[word >> 6] &= ~bit;
+            if(bits[word] == 0) empty[word >> 6] |= bit;
+            else empty[word >> 6] &= ~bit;
         }
 
-        // Splits the node by cutting out size elements from the back. It returns iterator to that second half.
-        LDNiter backSplit(LDNiter it, int size){
-            if(size > 0 && size < it->block_set.size()) {
-                LdiskNode second_half = it->backSplit(size);   // Gets the the second half
-                return nodes.insert(++it, second_half);
-            }else return it;
+        // Sets or clears the bits of a run of blocks
+        void mark(int start, int length, bool used){
+            int end = start + length;
+            while(start < end){
+                size_t word = start >> 6;
+                int low = start & 63;
+                int high = std::min(64, low + (end - start));
+                uint64_t mask = (high == 64 ? ~0ULL : (1ULL << high) - 1) & (~0ULL << low);
+                if(used) bits[word] |= mask;
+                else bits[word] &= ~mask;
+                updateSummary(word);
+                start += high - low;
+            }
         }
 
-        // Splits from a specified block and size elements from that block, inclusive.
-        LDNiter rangeSplit(int first, int size){
-            LDNiter node = findNode(first);
-            node = backSplit(node, node->block_set[node->block_set.size()-1] - first + 1);
-            node = split(node, size);
-            return node;
+        // First word at or after word whose bit in the summary is clear, or bits.size() if there is none
+        size_t nextWord(const std::vector<uint64_t>& summary, size_t word){
+            if(word >= bits.size()) return bits.size();
+            size_t index = word >> 6;
+            uint64_t candidates = ~summary[index] & (~0ULL << (word & 63));
+            if(candidates == 0){
+                index = firstNotEqual(summary.data(), index + 1, summary.size(), ~0ULL);
+                if(index >= summary.size()) return bits.size();
+                candidates = ~summary[index];
+            }
+            return index*64 + __builtin_ctzll(candidates);
         }
 
-        // Recombine contiguous free/occupied nodes
-        void recombine(){
-            std::list<LdiskNode> new_nodes; // Represents new nodes list
-            int mode=-1;                    // 1 when joining free blocks, 0 when joining occupied blocks, -1 is first iteration
+        // First free block at or after block, or block_count if there is none
+        int nextFree(int block){
+            if(block >= block_count) return block_count;
+            size_t word = block >> 6;
+            uint64_t candidates = ~bits[word] & (~0ULL << (block & 63));
+            if(candidates == 0){
+                word = nextWord(full, word + 1);
+                if(word >= bits.size()) return block_count;
+                candidates = ~bits[word];
+            }
+            return std::min(block_count, int(word*64 + __builtin_ctzll(candidates)));
+        }
 
-            for(LDNiter it=nodes.begin(); it != nodes.end(); ++it){
-                // What to do if the previous one was free
-                bool free = it->free;
-                if(mode == 1){
-                    if(free){
-                        new_nodes.back().append(it->block_set);
-                    }else{
-                        mode = 0;
-                        new_nodes.push_back(*it);
-                    }
-                // What to do if the previous one was occupied
-                }else if(mode == 0){
-                    if( !(free) ){
-                        new_nodes.back().append(it->block_set);
-                    }else{
-                        mode = 1;
-                        new_nodes.push_back(*it);
-                    }
-                // What to do if this is the first iteration
-                }else{
-                    if(free) mode = 1;
-                    else mode = 0;
-                    new_nodes.push_front(*it);
-                }
+        // First used block at or after block, or block_count if there is none
+        int nextUsed(int block){
+            if(block >= block_count) return block_count;
+            size_t word = block >> 6;
+            uint64_t candidates = bits[word] & (~0ULL << (block & 63));
+            if(candidates == 0){
+                word = nextWord(empty, word + 1);
+                if(word >= bits.size()) return block_count;
+                candidates = bits[word];
             }
-            nodes = new_nodes;
+            return std::min(block_count, int(word*64 + __builtin_ctzll(candidates)));
         }
 
-        // Allocate free blocks then returns the vector of all the filled blocks
-        std::vector<int> allocate(int size){
-            std::vector<int> blocks;    // The newly allocated blocks
-            if(size > sumFree()){
-                std::cout << "NOT ENOUGH SPACE TO GROW OR ADD FILE." << std::endl;
-                return blocks;
-            }else{
-                LDNiter it;
-                int node_size;
-                // Loops until all memory has been allocated to some free block.
-                while(size > 0){
-                    it = findFree();                    // Iterator to a free block
-                    node_size = it->block_set.size();   // The size of the free node
-                    if(size >= node_size){
-                        size -= node_size;              // Subtract the already allocated nodes
-                    }else{
-                        it = split(it, size);           // Splits then returns the first block of the split
-                        size = 0;                       // We're done
-                    }
-                    it->free = false;                   // Mark each allocated node as false
-                    std::copy(it->block_set.begin(), it->block_set.end(), std::back_inserter(blocks));  // Appends vector elements to blocks
+    public:
+        void initLdisk(int block_count){
+            this->block_count = block_count;
+            used_count = 0;
+            next_fit = 0;
+            bits.assign((block_count + 63) / 64, 0);
+            if(block_count & 63) bits.back() = ~0ULL << (block_count & 63);    // Blocks past the end never look free
+            // Summary bits past the last word stay set in both summaries so searches skip them
+            full.assign((bits.size() + 63) / 64, ~0ULL);
+            empty.assign(full.size(), ~0ULL);
+            for(size_t word = 0; word < bits.size(); word++) updateSummary(word);
+        }
+
+        int sumOccupied(){
+            return used_count;
+        }
+
+        int sumFree(){
+            return block_count - used_count;
+        }
+
+        void diskFootprint(){
+            int block = 0;
+            while(block < block_count){
+                bool free = (bits[block >> 6] >> (block & 63) & 1) == 0;
+                int end = free ? nextUsed(block) : nextFree(block);
+                printExtent(free, block, end - block);
+                block = end;
+            }
+        }
+
+        int largestFree(){
+            int largest = 0, start, length, from = 0;
+            while(findRun(largest + 1, from, start, length)){
+                largest = length;
+                from = start + length;
+            }
+            return largest;
+        }
+
+        int freeExtents(){
+            int count = 0, start, length, from = 0;
+            while(findRun(1, from, start, length)){
+                count++;
+                from = start + length;
+            }
+            return count;
+        }
+
+        void usedExtents(std::vector<Extent>& runs){
+            int block = nextUsed(0);
+            while(block < block_count){
+                int end = nextFree(block);
+                runs.push_back(Extent(block, end - block));
+                block = nextUsed(end);
+            }
+        }
+
+        void free(const std::vector<Extent>& released){
+            for(size_t i = 0; i < released.size(); i++){
+                mark(released[i].start, released[i].length, false);
+                used_count -= released[i].length;
+            }
+        }
+
+    protected:
+        bool findRun(int size, int from, int& start, int& length){
+            int block = nextFree(from);
+            while(block < block_count){
+                int end = nextUsed(block);
+                if(end - block >= size){
+                    start = block;
+                    length = end - block;
+                    return true;
                 }
-                recombine();                            // Reorganize separated blocks
-                return blocks;
+                block = nextFree(end);
             }
+            return false;
         }
 
-        // Frees memory starting at block i up to size number of blocks
-        void free(std::vector<int> free_blocks){
-            LDNiter node;
-            // Get a range of contiguous blocks and send it to split
-            std::vector<int>::iterator it = free_blocks.begin();
-            int first = *it;
-            int prev = *it;
-            int cur;
-            while(it != free_blocks.end()){
-                cur = *(++it);
-                // If not contiguous, free the currently saved contiguous blocks
-                if(cur-prev != 1){
-                    node = rangeSplit(first, prev-first+1);
-                    node->free = true;
-                    first = *it;
+        bool findBest(int size, int& start, int& length){
+            int best = 0, run_start, run_length, from = 0;
+            while(findRun(size, from, run_start, run_length)){
+                if(best == 0 || run_length < best){
+                    best = run_length;
+                    start = run_start;
+                    length = run_length;
+                    if(best == size) break;     // An exact fit cannot be beaten
                 }
-                prev = *it;
+                from = run_start + run_length;
             }
-            recombine();
+            return best > 0;
+        }
+
+        void take(int start, int length){
+            mark(start, length, true);
+            used_count += length;
         }
 };
 
-Ldisk LDISK;
+// Makes the disk backend with the given name, or NULL if there is none
+Ldisk* makeLdisk(std::string name){
+    if(name == "list") return new ExtentLdisk();
+    if(name == "bitmap") return new BitmapLdisk();
+    return NULL;
+}
+
+Ldisk* LDISK;
+
+// Collects output and hands it to std::cout in large writes, so long listings don't flush on every line
+class OutputBuffer{
+    private:
+        static const size_t CHUNK = 1 << 16;   // Bytes held before they are written out
+        std::string buffer;
+
+    public:
+        ~OutputBuffer(){
+            flush();
+        }
+
+        OutputBuffer& operator<<(std::string_view text){
+            buffer.append(text.data(), text.size());
+            if(buffer.size() >= CHUNK) flush();
+            return *this;
+        }
+
+        OutputBuffer& operator<<(char c){
+            buffer += c;
+            return *this;
+        }
+
+        OutputBuffer& operator<<(int value){
+            char digits[16];
+            return *this << std::string_view(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr - digits);
+        }
+
+        void flush(){
+            std::cout.write(buffer.data(), buffer.size());
+            std::cout.flush();
+            buffer.clear();
+        }
+};
 
 class Lfile{
     public:
-        std::list<int> addresses;
+        std::vector<Extent> extents;    // Runs of blocks holding the file, in file order
+        int block_count = 0;            // Total number of blocks across all extents
+
+        // Number of blocks needed to hold filesize bytes
+        static int blocksFor(int filesize){
+            return ceil( float(filesize) / float(BLOCKSIZE) );
+        }
+
         void initLfile(int filesize) {
             if(filesize > 0){
-                int block_count = ceil( float(filesize) / float(BLOCKSIZE) );
-                std::vector<int> blocks = LDISK.allocate(block_count);                  // Allocates the given number of blocks
-                std::copy(blocks.begin(), blocks.end(), std::back_inserter(addresses)); // Appends vector elements to addresses list
+                addExtents(LDISK->allocate(blocksFor(filesize)));               // Allocates the given number of blocks
+            }
+        }
+
+        // Adds runs to the end of the file, merging a run that continues the last one
+        void addExtents(const std::vector<Extent>& added){
+            for(size_t i = 0; i < added.size(); i++){
+                if(!extents.empty() && extents.back().end() == added[i].start){
+                    extents.back().length += added[i].length;
+                }else{
+                    extents.push_back(added[i]);
+                }
+                block_count += added[i].length;
             }
         }
 
         // Prints all addresses in the format 1231232->12312233->123123123
-        void print(){
-            for(std::list<int>::iterator it=addresses.begin(); it != addresses.end(); ++it){
-                if(it != addresses.begin()) std::cout << "->";
-                std::cout << *it;
+        void print(OutputBuffer& out){
+            bool first = true;
+            for(size_t i = 0; i < extents.size(); i++){
+                for(int block = extents[i].start; block < extents[i].end(); block++){
+                    if(!first) out << "->";
+                    out << block;
+                    first = false;
+                }
             }
-            std::cout << std::endl;
+            out << '\n';
         }
 
         // Updates the Lfile's list of addresses to correspond to the given filesize
         void updateNumBlocks(int new_filesize){
-            int block_count = ceil( float(new_filesize) / float(BLOCKSIZE) );
-            int old_size = addresses.size();
-            if(block_count > old_size){
-                std::vector<int> blocks = LDISK.allocate(block_count - old_size);       // Get new blocks
-                std::copy(blocks.begin(), blocks.end(), std::back_inserter(addresses)); // Appends vector elements to addresses list
-            }else if(block_count < old_size){
-                std::list<int>::iterator it = addresses.begin();
-                for(int i = 0; i < block_count; ++it, ++i);                             // Go to the cut off point
-                std::vector<int> free_blocks(it, addresses.end());                      // Copy the cut off blocks
-                LDISK.free(free_blocks);
-                addresses.erase(it, addresses.end());
+            int new_count = blocksFor(new_filesize);
+            if(new_count > block_count){
+                addExtents(LDISK->allocate(new_count - block_count));           // Get new blocks
+            }else if(new_count < block_count){
+                std::vector<Extent> free_extents;                               // The cut off runs
+                int cut = block_count - new_count;
+                while(cut > 0){
+                    Extent& last = extents.back();
+                    if(last.length <= cut){
+                        cut -= last.length;
+                        free_extents.push_back(last);
+                        extents.pop_back();
+                    }else{
+                        last.length -= cut;
+                        free_extents.push_back(Extent(last.end(), cut));
+                        cut = 0;
+                    }
+                }
+                block_count = new_count;
+                LDISK->free(free_extents);
             }
         }
 };
 
-class FileTree{
-    private:
-        struct TreeNode{
-            std::string name;
-            std::string path;
-            bool is_dir;
-            TreeNode *parent;
+// A listing file mapped read-only into memory
+class MappedFile{
+    public:
+        const char* data = NULL;
+        size_t size = 0;
 
-            // Only for directories
-            std::map<std::string, TreeNode> nodes;
+        ~MappedFile(){
+            close();
+        }
 
-            // Only for files
-            int size;
-            std::string time;
-            Lfile lfile;
-        };
-        TreeNode root;
-        TreeNode* cur_dir;
-        typedef std::map<std::string, TreeNode>::iterator treeMapIter;
-    public:
-        FileTree(){
-            root.name = "/";
-            root.is_dir = true;
-            root.parent = &root;    // So that when you move to the parent, it goes back to itself
-            cur_dir = &root;
+        // Maps the whole file. Returns false if it cannot be opened.
+        bool open(std::string name){
+            close();
+            int fd = ::open(name.c_str(), O_RDONLY);
+            if(fd < 0) return false;
+            struct stat info;
+            bool ok = fstat(fd, &info) == 0;
+            if(ok && info.st_size > 0){
+                void* mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(mapped == MAP_FAILED){
+                    ok = false;
+                }else{
+                    data = (const char*)mapped;
+                    size = info.st_size;
+                    madvise(mapped, size, MADV_SEQUENTIAL);
+                }
+            }
+            ::close(fd);
+            return ok;
         }
 
-        TreeNode* getCurDir(){
-            return cur_dir;
+        void close(){
+            if(data != NULL) munmap((void*)data, size);
+            data = NULL;
+            size = 0;
         }
 
-        // Gets the level of the tree. Used in breadth first traversal.
-        int getLevel(){
-            return getLevelHelper(root, 1);
+        std::string_view view(){
+            return std::string_view(data, size);
         }
-        int getLevelHelper(TreeNode& tree, int level){
-            if(tree.nodes.size() > 0){
-                int max = level+1;
-                int new_level;
-                for(treeMapIter it=tree.nodes.begin(); it != tree.nodes.end(); ++it){
-                    new_level = getLevelHelper(it->second, level+1);
-                    if(new_level > max) max = new_level;
-                }
-                return max;
-            }else return level;
+};
+
+// Takes the next line off the front of rest, without its newline. Returns false once rest is empty.
+bool nextLine(std::string_view& rest, std::string_view& line){
+    if(rest.empty()) return false;
+    size_t end = rest.find('\n');
+    if(end == std::string_view::npos){
+        line = rest;
+        rest = std::string_view();
+    }else{
+        line = rest.substr(0, end);
+        rest.remove_prefix(end + 1);
+    }
+    return true;
+}
+
+// Reads one line of the find -ls listing into the file's size, timestamp and path. Columns are split on single spaces with
+// empty tokens skipped, and the timestamp and path columns are joined back with one space. time and path are reused
+// buffers, so nothing is allocated per token. The size is left alone when the line has no size column.
+void parseListingLine(std::string_view line, int& size, std::string& time, std::string& path){
+    int column = -1;    // Keeps track of which column we're currently observing
+    time.clear();
+    path.clear();
+    while(!line.empty()){
+        size_t end = line.find(' ');
+        std::string_view item = line.substr(0, end);
+        line.remove_prefix(end == std::string_view::npos ? line.size() : end + 1);
+        if(item.length() != 0){
+            ++column;
+            if (column == 6){
+                // Same as reading an int from a stream: optional sign then digits, 0 if there are none
+                size_t i = 0;
+                bool negative = item[0] == '-';
+                if(item[0] == '-' || item[0] == '+') i++;
+                long long value = 0;
+                for(; i < item.size() && item[i] >= '0' && item[i] <= '9'; i++) value = value*10 + (item[i] - '0');
+                size = negative ? -value : value;
+            }else if(column == 7 || column == 8 || column == 9){
+                if(column != 7) time += ' ';
+                time.append(item.data(), item.size());
+            }else if(column >= 10){
+                if(column != 10) path += ' ';
+                path.append(item.data(), item.size());
+            }
+        }
+    }
+}
+
+// Orders paths one component at a time, so a directory sorts right before its own subdirectories and the children of every
+// directory come out in the same order as its map
+bool componentLess(const std::string& a, const std::string& b){
+    size_t n = std::min(a.size(), b.size());
+    for(size_t i = 0; i < n; i++){
+        if(a[i] != b[i]){
+            if(a[i] == '/') return true;
+            if(b[i] == '/') return false;
+            return (unsigned char)a[i] < (unsigned char)b[i];
+        }
+    }
+    return a.size() < b.size();
+}
+
+// Snapshot image written by the save command. The header is followed by four sections, each starting on an 8-byte boundary:
+// the node table, the file extents, the runs in use on the disk and the string pool. Nodes are stored breadth first with each
+// directory's children next to each other in name order, so parents come before children and every reference is an index
+// or an offset into the string pool. The checksum covers everything after the header.
+const char SNAPSHOT_MAGIC[8] = {'A', '3', 'S', 'N', 'A', 'P', '\0', '\0'};
+const uint32_t SNAPSHOT_VERSION = 2;
+
+struct SnapshotHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;       // sizeof(SnapshotHeader), so a mismatched layout is rejected
+    int32_t block_size;
+    int32_t block_count;
+    int32_t next_fit;           // Where the next-fit search resumes
+    uint32_t node_count;
+    uint64_t extent_count;
+    uint64_t run_count;
+    uint64_t string_bytes;
+    uint64_t nodes_offset;      // Byte offsets of the sections from the start of the image
+    uint64_t extents_offset;
+    uint64_t runs_offset;
+    uint64_t strings_offset;
+    uint64_t image_size;
+    uint64_t checksum;
+};
+
+struct SnapshotNode{
+    uint32_t parent;            // Index of the parent directory; the root is its own parent
+    uint32_t first_child;       // Index of the first child
+    uint32_t child_count;
+    uint32_t name;              // Offsets into the string pool
+    uint32_t time;
+    int32_t size;
+    uint32_t is_dir;
+    uint32_t extent_count;
+    uint64_t first_extent;      // Index of the file's first extent
+};
+
+// 64-bit checksum of a byte range, eight bytes per step
+uint64_t checksum(const char* data, size_t size){
+    uint64_t hash = 14695981039346656037ULL;
+    size_t i = 0;
+    for(; i + 8 <= size; i += 8){
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 1099511628211ULL;
+        hash ^= hash >> 29;
+    }
+    for(; i < size; i++) hash = (hash ^ (unsigned char)data[i]) * 1099511628211ULL;
+    return hash;
+}
+
+// Rounds an offset up to the next 8-byte boundary
+uint64_t align8(uint64_t offset){
+    return (offset + 7) & ~uint64_t(7);
+}
+
+const uint32_t NO_INDEX = 0xFFFFFFFF;   // Marks a missing or freed node
+
+// Strings stored once each, back to back in one buffer, and named by their offset into it. Snapshots save the buffer as is.
+// Lookups go through an open-addressing table of offsets that is rebuilt from the buffer whenever it runs out of room,
+// including the first time after a snapshot is loaded.
+class StringPool{
+    private:
+        std::vector<char> chars;        // NUL-terminated strings
+        std::vector<uint32_t> slots;    // Offsets of the strings, NO_INDEX when unused. The size is a power of two.
+        size_t count = 0;               // Strings in slots
+
+        static uint64_t hash(std::string_view value){
+            uint64_t hash = 14695981039346656037ULL;
+            for(size_t i = 0; i < value.size(); i++) hash = (hash ^ (unsigned char)value[i]) * 1099511628211ULL;
+            return hash;
         }
 
-        // Prints directory structure breadth first
-        void printDir(){
-            int levels = getLevel();
-            for(int i = 0; i < levels; i++){
-                std::cout << "[Dir Level: " << i << "]" << std::endl;
-                printDirHelper(root, i);
-                std::cout << std::endl;
+        // Slot holding value, or the unused slot where it would go
+        size_t probe(std::string_view value){
+            size_t mask = slots.size() - 1;
+            for(size_t slot = hash(value) & mask; ; slot = (slot + 1) & mask){
+                if(slots[slot] == NO_INDEX || view(slots[slot]) == value) return slot;
             }
         }
-        void printDirHelper(TreeNode& tree, int depth){
-            if(depth != 0){
-                for(treeMapIter it=tree.nodes.begin(); it != tree.nodes.end(); ++it){
-                    if(it->second.is_dir) printDirHelper(it->second, depth-1);
+
+        // Rebuilds the table from the buffer, at most half full
+        void grow(){
+            size_t strings = std::count(chars.begin(), chars.end(), '\0') + 1;
+            size_t capacity = 16;
+            while(capacity < strings * 2) capacity *= 2;
+            slots.assign(capacity, NO_INDEX);
+            count = 0;
+            for(size_t offset = 0; offset < chars.size(); offset += strlen(chars.data() + offset) + 1){
+                size_t slot = probe(view(offset));
+                if(slots[slot] == NO_INDEX){
+                    slots[slot] = offset;
+                    count++;
                 }
-            }else{
-                if(tree.is_dir) std::cout << tree.path << tree.name << std::endl;
             }
         }
 
-        // Prints Files breadth first
-        void printFiles(){
-            int levels = getLevel();
-            for(int i = 0; i < levels; i++){
-                std::cout << "[File Level: " << i << "]" << std::endl;
-                printFilesHelper(root, i);
+    public:
+        // Offset of value, adding it the first time it is seen
+        uint32_t intern(std::string_view value){
+            if((count + 1) * 2 > slots.size()) grow();
+            size_t slot = probe(value);
+            if(slots[slot] == NO_INDEX){
+                slots[slot] = chars.size();
+                chars.insert(chars.end(), value.begin(), value.end());
+                chars.push_back('\0');
+                count++;
             }
+            return slots[slot];
+        }
+
+        std::string_view view(uint32_t offset){
+            return std::string_view(chars.data() + offset);
+        }
+
+        const char* data(){
+            return chars.data();
+        }
+
+        size_t size(){
+            return chars.size();
+        }
+
+        // Takes over a buffer saved by a snapshot. The table is rebuilt on the next intern.
+        void assign(const char* data, size_t size){
+            chars.assign(data, data + size);
+            slots.clear();
+            count = 0;
         }
-        void printFilesHelper(TreeNode& tree, int depth){
-            if(depth != 0){
-                for(treeMapIter it=tree.nodes.begin(); it != tree.nodes.end(); ++it){
-                    printFilesHelper(it->second, depth-1);
+};
+
+class FileTree{
+    private:
+        struct TreeNode{
+            uint32_t name;      // Name in the string pool
+            uint32_t time;      // Timestamp in the string pool
+            uint32_t parent;    // Index of the parent directory, NO_INDEX once the node is freed
+            uint32_t data;      // Index of the children list for directories, of the Lfile for files
+            int size;           // Only for files
+            bool is_dir;
+        };
+        std::vector<TreeNode> nodes;                        // Arena of all nodes. Index 0 is the root.
+        std::vector<std::vector<uint32_t> > children;       // Children of each directory, sorted by name
+        std::vector<Lfile> lfiles;                          // Blocks of each file
+        std::vector<uint32_t> free_nodes;                   // Freed slots in the three arenas, reused first
+        std::vector<uint32_t> free_children;
+        std::vector<uint32_t> free_lfiles;
+        StringPool strings;                                 // Names and timestamps
+        uint32_t cur_dir;
+        std::string cur_path;                               // Valid path of the current directory ("/" or "/a/b/")
+        std::unordered_map<std::string, uint32_t> dentries; // Valid absolute directory path to its node, filled as paths resolve
+        std::string dentry_key;                             // Buffers reused by every lookup so paths are not copied around
+        std::string valid_path;
+
+        // Takes a node slot and gives it an empty children list or Lfile
+        uint32_t newNode(uint32_t name, uint32_t time, uint32_t parent, int size, bool is_dir){
+            TreeNode node;
+            node.name = name;
+            node.time = time;
+            node.parent = parent;
+            node.size = size;
+            node.is_dir = is_dir;
+            if(is_dir){
+                if(free_children.empty()){
+                    node.data = children.size();
+                    children.push_back(std::vector<uint32_t>());
+                }else{
+                    node.data = free_children.back();
+                    free_children.pop_back();
                 }
             }else{
-                if(!tree.is_dir){
-                    std::cout << "File name: " << tree.name << std::endl;
-                    std::cout << "File path: " << tree.path << std::endl;
-                    std::cout << "File size: " << tree.size << std::endl;
-                    std::cout << "File timestamp: " << tree.time << std::endl;
-                    std::cout << "Addresses: ";
-                    tree.lfile.print();
+                if(free_lfiles.empty()){
+                    node.data = lfiles.size();
+                    lfiles.push_back(Lfile());
+                }else{
+                    node.data = free_lfiles.back();
+                    free_lfiles.pop_back();
+                    lfiles[node.data] = Lfile();
+                }
+            }
+            if(free_nodes.empty()){
+                nodes.push_back(node);
+                return nodes.size() - 1;
+            }
+            uint32_t index = free_nodes.back();
+            free_nodes.pop_back();
+            nodes[index] = node;
+            return index;
+        }
+
+        // Returns a node and its children list or Lfile to the free slots
+        void freeNode(uint32_t index){
+            TreeNode& node = nodes[index];
+            if(node.is_dir){
+                children[node.data].clear();
+                free_children.push_back(node.data);
+            }else{
+                lfiles[node.data] = Lfile();
+                free_lfiles.push_back(node.data);
+            }
+            node.parent = NO_INDEX;
+            free_nodes.push_back(index);
+        }
+
+        std::string_view nameOf(uint32_t index){
+            return strings.view(nodes[index].name);
+        }
+
+        std::vector<uint32_t>& childrenOf(uint32_t index){
+            return children[nodes[index].data];
+        }
+
+        Lfile& lfileOf(uint32_t index){
+            return lfiles[nodes[index].data];
+        }
+
+        // Position of the first child not ordered before name
+        size_t childPosition(uint32_t dir, std::string_view name){
+            std::vector<uint32_t>& list = childrenOf(dir);
+            size_t low = 0, high = list.size();
+            while(low < high){
+                size_t middle = (low + high) / 2;
+                if(nameOf(list[middle]) < name) low = middle + 1;
+                else high = middle;
+            }
+            return low;
+        }
+
+        // Finds the child of dir with the given name, or NO_INDEX
+        uint32_t findChild(uint32_t dir, std::string_view name){
+            std::vector<uint32_t>& list = childrenOf(dir);
+            size_t position = childPosition(dir, name);
+            if(position < list.size() && nameOf(list[position]) == name) return list[position];
+            return NO_INDEX;
+        }
+
+        // Adds a child in name order. Returns NO_INDEX if dir already has a child with that name.
+        uint32_t addChild(uint32_t dir, std::string_view name, uint32_t time, int size, bool is_dir){
+            size_t position = childPosition(dir, name);
+            std::vector<uint32_t>& list = childrenOf(dir);
+            if(position < list.size() && nameOf(list[position]) == name) return NO_INDEX;
+            uint32_t child = newNode(strings.intern(name), time, dir, size, is_dir);
+            childrenOf(dir).insert(childrenOf(dir).begin() + position, child);
+            return child;
+        }
+
+        // Unlinks a child from its directory and frees it. A directory also drops out of the path cache. Only directories
+        // that resolved are cached, so adding one never makes an entry stale and only a delete needs to invalidate.
+        void removeChild(uint32_t dir, uint32_t child){
+            std::vector<uint32_t>& list = childrenOf(dir);
+            list.erase(list.begin() + childPosition(dir, nameOf(child)));
+            if(nodes[child].is_dir) dentries.erase(pathOf(child) + std::string(nameOf(child)) + "/");
+            if(cur_dir == child) moveUp();
+            freeNode(child);
+        }
+
+        // Cuts a file down by amt bytes and stamps it with the current time
+        void shrink(uint32_t file, int amt){
+            nodes[file].size -= amt;
+            if(nodes[file].size < 0){
+                nodes[file].size = 0;
+            }
+            lfileOf(file).updateNumBlocks(nodes[file].size);
+            nodes[file].time = strings.intern(getCurTime());
+        }
+
+        // A node waiting to be printed and where the path of the directory holding it sits in its level's path buffer
+        struct Visit{
+            uint32_t node;
+            uint32_t path;
+            uint32_t length;
+        };
+
+        // Prints the tree under start one level at a time, directories or files, with a "[Dir Level: i]" or "[File Level: i]"
+        // header for every level that has nodes in it. Each level is made from the children of the one before, in order, so the
+        // whole listing is one pass. A directory's path is built once and shared by everything in it.
+        void printLevels(uint32_t start, int max_depth, bool files){
+            OutputBuffer out;
+            std::vector<Visit> level, next;
+            std::string paths = pathOf(start), next_paths;
+            level.push_back(Visit{start, 0, (uint32_t)paths.size()});
+            for(int depth = 0; !level.empty() && (max_depth < 0 || depth <= max_depth); depth++){
+                out << (files ? "[File Level: " : "[Dir Level: ") << depth << "]\n";
+                next.clear();
+                next_paths.clear();
+                for(size_t i = 0; i < level.size(); i++){
+                    const TreeNode& node = nodes[level[i].node];
+                    std::string_view path(paths.data() + level[i].path, level[i].length);
+                    if(node.is_dir){
+                        if(!files) out << path << nameOf(level[i].node) << '\n';
+                        std::vector<uint32_t>& list = children[node.data];
+                        if(list.empty()) continue;
+                        // Everything in this directory is held by its full path. The root's is just "/".
+                        uint32_t offset = next_paths.size();
+                        if(level[i].node != 0){
+                            next_paths += path;
+                            next_paths += nameOf(level[i].node);
+                        }
+                        next_paths += '/';
+                        for(size_t c = 0; c < list.size(); c++) next.push_back(Visit{list[c], offset, (uint32_t)(next_paths.size() - offset)});
+                    }else if(files){
+                        out << "File name: " << nameOf(level[i].node) << '\n';
+                        out << "File path: " << path << '\n';
+                        out << "File size: " << node.size << '\n';
+                        out << "File timestamp: " << strings.view(node.time) << '\n';
+                        out << "Addresses: ";
+                        lfiles[node.data].print(out);
+                    }
                 }
+                if(!files) out << '\n';
+                level.swap(next);
+                paths.swap(next_paths);
+            }
+        }
+
+        // Splits a path into its directory (ending in a slash, or empty for the current directory) and its last name.
+        // Both point into the makePathValid buffer.
+        void splitPath(std::string_view full_path, std::string_view& path, std::string_view& name){
+            std::string_view valid = makePathValid(full_path);
+            valid.remove_suffix(1);                 // Remove last slash
+            size_t loc = valid.rfind('/');          // npos + 1 wraps to 0 for a bare name
+            name = valid.substr(loc+1);
+            path = valid.substr(0, loc+1);
+        }
+
+    public:
+        FileTree(){
+            strings.intern("");
+            cur_dir = newNode(strings.intern("/"), strings.intern(""), 0, 0, true);    // The root is its own parent, so moving up from it stays put
+            cur_path = "/";
+        }
+
+        // Path of the directory holding a node, rebuilt from the parent links: "" for the root, "/" for its children,
+        // then "/a/b/" further down
+        std::string pathOf(uint32_t index){
+            std::vector<uint32_t> ancestors;
+            for(uint32_t dir = nodes[index].parent; index != 0 && dir != 0; dir = nodes[dir].parent) ancestors.push_back(dir);
+            if(index == 0) return "";
+            std::string path = "/";
+            for(size_t i = ancestors.size(); i > 0; i--){
+                path += nameOf(ancestors[i-1]);
+                path += '/';
             }
+            return path;
+        }
+
+        // Full path of the current directory, without the trailing slash
+        std::string getCurPath(){
+            if(cur_dir == 0) return cur_path;
+            return cur_path.substr(0, cur_path.size()-1);
+        }
+
+        // Prints directory structure breadth first. Starts from root, or from the directory at path, and stops after max_depth
+        // levels below it unless max_depth is negative.
+        void printDir(std::string_view path = "", int max_depth = -1){
+            uint32_t start = path.empty() ? 0 : getDirectory(makePathValid(path));
+            if(start != NO_INDEX) printLevels(start, max_depth, false);
+        }
+
+        // Prints Files breadth first, with the same options as printDir
+        void printFiles(std::string_view path = "", int max_depth = -1){
+            uint32_t start = path.empty() ? 0 : getDirectory(makePathValid(path));
+            if(start != NO_INDEX) printLevels(start, max_depth, true);
         }
 
         // Gets total size
         int getTotalSize(){
-            return getSizeHelper(root);
-        }
-        int getSizeHelper(TreeNode& tree){
             int size = 0;
-            if(!tree.is_dir) size += tree.size;
-            else{
-                for(treeMapIter it=tree.nodes.begin(); it != tree.nodes.end(); ++it) size += getSizeHelper(it->second);
+            for(size_t i = 0; i < nodes.size(); i++){
+                if(nodes[i].parent != NO_INDEX && !nodes[i].is_dir) size += nodes[i].size;
             }
             return size;
         }
@@ -395,140 +1204,419 @@ class FileTree{
             return time;
         }
 
-        // Changes ' ' to '\ '
-        std::string escapeSpace(std::string original){
-            int loc;
-            if((loc = original.find("\\ ")) == std::string::npos){
-                while((loc = original.find(" ")) != std::string::npos){
-                    original.replace(loc, 1, "\\$%$");    // I replaced it with a weird sequence not a space since space loops forever
-                }
-                while((loc = original.find("$%$")) != std::string::npos){
-                    original.replace(loc, 3," ");
-                }  
-            }
-            return original;
-        }
-
-        // Finds the directory to add new files/folders into.
-        TreeNode* getDirectory(std::string path){
-            int loc;
-            TreeNode *current;
-            std::string name, path_traversal = path;
-            if(path[0] != '/'){
-                current = cur_dir;              // If the path doesn't start with a slash, work locally
+        // Finds the directory to add new files/folders into. Returns NO_INDEX if there is none. The path has to be valid.
+        // Directories found by walking the tree are cached under their absolute path, so later lookups of the same
+        // directory are a single hash probe however deep it is. Leaves the absolute path in dentry_key.
+        uint32_t getDirectory(std::string_view path){
+            uint32_t current;
+            std::string_view path_traversal = path;
+            dentry_key.clear();
+            if(path.empty() || path[0] != '/'){
+                current = cur_dir;                  // If the path doesn't start with a slash, work locally
+                dentry_key = cur_path;
             }else{
-                current = &root;                // Otherwise work from root
-                path_traversal.erase(0,1);      // Get rid of first '/'
+                current = 0;                        // Otherwise work from root
+                path_traversal.remove_prefix(1);    // Get rid of first '/'
             }
-            while((loc = path_traversal.find("/")) != std::string::npos){
-                name = path_traversal.substr(0, loc);
-                path_traversal.erase(0, loc+1);           // +1 to delete the slash
+            dentry_key.append(path.data(), path.size());
+            std::unordered_map<std::string, uint32_t>::iterator cached = dentries.find(dentry_key);
+            if(cached != dentries.end()) return cached->second;
+
+            size_t loc;
+            while((loc = path_traversal.find('/')) != std::string_view::npos){
+                std::string_view name = path_traversal.substr(0, loc);
+                path_traversal.remove_prefix(loc+1);      // +1 to delete the slash
                 // Add a directory if missing or get the directory
-                if(current->nodes.find(name) != current->nodes.end()){
-                    current = &(current->nodes[name]);
+                uint32_t next = nodes[current].is_dir ? findChild(current, name) : NO_INDEX;
+                if(next != NO_INDEX){
+                    current = next;
                 }else{
                     std::cout << "Directory not found: " << path << std::endl;
-                    current = NULL;
-                    break;
+                    return NO_INDEX;
                 }
             }
-            if(current != NULL && !(current->is_dir)) {
+            if(!(nodes[current].is_dir)) {
                 std::cout << "Not a directory: " << path << std::endl;
-                current = NULL;   
+                return NO_INDEX;
             }
+            dentries[dentry_key] = current;
             return current;
         }
 
-        // Makes the path valid (remove double slashes and add a slash at the end)
-        std::string makePathValid(std::string path){
-            int loc;
-            while((loc = path.find("//")) != std::string::npos) path.erase(loc, 1);
-            if(path[path.size()-1] != '/') path += "/";
-            path = escapeSpace(path);
-            return path;
+        // Makes the path valid (remove double slashes, change ' ' to '\ ' unless some space is already escaped and add a
+        // slash at the end). The result lives in a buffer that the next call overwrites.
+        std::string_view makePathValid(std::string_view path){
+            bool escape = path.find("\\ ") == std::string_view::npos;
+            valid_path.clear();
+            for(size_t i = 0; i < path.size(); i++){
+                if(path[i] == '/' && !valid_path.empty() && valid_path.back() == '/') continue;
+                if(path[i] == ' ' && escape) valid_path += '\\';
+                valid_path += path[i];
+            }
+            if(valid_path.empty() || valid_path.back() != '/') valid_path += '/';
+            return valid_path;
         }
 
         // Changes directory
-        void chdir(std::string path){
-            path = makePathValid(path);
-            TreeNode* dir = getDirectory(path);
+        void chdir(std::string_view path){
+            uint32_t dir = getDirectory(makePathValid(path));
             // Only update on valid directories
-            if(dir != NULL) cur_dir = dir;
+            if(dir != NO_INDEX){
+                cur_dir = dir;
+                cur_path = dentry_key;
+            }
         }
 
         // Used to print out all files in the directory
         void ls(){
-            for(treeMapIter it=cur_dir->nodes.begin(); it != cur_dir->nodes.end(); ++it){
-                if(it != cur_dir->nodes.begin()) std::cout << " ";
-                std::cout << it->second.name;
+            std::vector<uint32_t>& list = childrenOf(cur_dir);
+            for(size_t i = 0; i < list.size(); i++){
+                if(i != 0) std::cout << " ";
+                std::cout << nameOf(list[i]);
             }
             std::cout << std::endl;
         }
 
         // Moves up a directory
         void moveUp(){
-            cur_dir = cur_dir->parent;
+            cur_dir = nodes[cur_dir].parent;
+            cur_path.erase(cur_path.rfind('/', cur_path.size()-2) + 1);    // Drop the last name, the root stays "/"
         }
 
         // Adds a directory
-        void addDirectory(std::string full_path){
-            full_path = makePathValid(full_path);
-            full_path = full_path.substr(0, full_path.size()-1);    // Remove last slash
-            int loc = full_path.rfind("/");
-            std::string name = full_path.substr(loc+1);
+        void addDirectory(std::string_view full_path){
+            std::string_view path, name;
+            splitPath(full_path, path, name);
             if(name != ""){                                         // If the given input had some characters besides slashes
-                std::string path = full_path.substr(0, loc+1);
-                TreeNode* parent = getDirectory(path);                // Get the parent
-                if(parent->nodes.find(name) == parent->nodes.end()){    // Check if folder already exists
-                    TreeNode new_dir;
-                    new_dir.name = name;
-                    new_dir.path = path;
-                    new_dir.is_dir = true;
-                    new_dir.parent = parent;
-                    parent->nodes[name] = new_dir;
-                }else std::cout << "Folder already exists." << std::endl;
+                uint32_t parent = getDirectory(path);               // Get the parent
+                if(parent == NO_INDEX) return;
+                // Check if folder already exists
+                if(addChild(parent, name, strings.intern(""), 0, true) == NO_INDEX) std::cout << "Folder already exists." << std::endl;
             }
         }
 
         // Adds a file at the given path which has the given size and timestamp
-        void addFile(std::string full_path, int size, std::string time){
-            full_path = makePathValid(full_path);
-            full_path = full_path.substr(0, full_path.size()-1);    // Remove last slash
-            int loc = full_path.rfind("/");
-            std::string name = full_path.substr(loc+1);
+        void addFile(std::string_view full_path, int size, std::string_view time){
+            std::string_view path, name;
+            splitPath(full_path, path, name);
             if(name != ""){                                         // If the given input had some characters besides slashes
-                std::string path = full_path.substr(0, loc+1);      // Remove root characters
-                TreeNode* dir = getDirectory(path);                 // Get the parent
-                if(dir->nodes.find(name) == dir->nodes.end()){      // Check if file already exists
-                    TreeNode new_file;
-                    new_file.name = name;
-                    new_file.path = path;
-                    new_file.is_dir = false;
-                    new_file.parent = dir;
-                    new_file.size = size;
-                    new_file.time = time;
-                    new_file.lfile.initLfile(size);
-                    dir->nodes[name] = new_file;  
-                }else std::cout << "File already exists." << std::endl;
+                uint32_t dir = getDirectory(path);                  // Get the parent
+                if(dir == NO_INDEX) return;
+                uint32_t new_file = addChild(dir, name, strings.intern(time), size, false);
+                if(new_file != NO_INDEX) lfileOf(new_file).initLfile(size);
+                else std::cout << "File already exists." << std::endl;  // Check if file already exists
+            }
+        }
+
+        // Loads the directory and file listings. Both are memory-mapped and parsed in place. Directories are sorted so each one
+        // lands after its parent and in order among its siblings, and each one is put in the path cache so files find their
+        // directory without walking from root. Files are appended to their directory as they come and each directory is sorted once at the end.
+        // Every file's blocks go to the disk as one batched request in listing order, so the layout is the same as adding the
+        // files one at a time.
+        void bulkLoad(std::string dir_list, std::string file_list){
+            uint32_t no_time = strings.intern("");
+            std::string_view rest, line;
+
+            MappedFile listing;
+            if(listing.open(dir_list)){
+                std::vector<std::string> paths;
+                rest = listing.view();
+                while(nextLine(rest, line)){
+                    // substr(1) gets rid of the period
+                    if(line.size() > 1) paths.push_back(std::string(makePathValid(line.substr(1))));
+                }
+                std::sort(paths.begin(), paths.end(), componentLess);
+                for(size_t i = 0; i < paths.size(); i++){
+                    std::string_view full(paths[i].data(), paths[i].size()-1);     // Remove last slash
+                    size_t loc = full.rfind('/');
+                    std::string_view name = full.substr(loc+1);
+                    if(name.empty()) continue;
+                    uint32_t parent = getDirectory(full.substr(0, loc+1));
+                    if(parent == NO_INDEX) continue;
+                    // Every directory goes in the cache now. Children lists are only sorted again after the files are in,
+                    // so the file pass cannot walk the tree.
+                    uint32_t new_dir = addChild(parent, name, no_time, 0, true);
+                    if(new_dir != NO_INDEX) dentries[dentry_key + std::string(name) + "/"] = new_dir;
+                    else std::cout << "Folder already exists." << std::endl;
+                }
+            }
+            listing.close();
+
+            if(listing.open(file_list)){
+                std::cout << "Loading Files! Hold on, should take a minute." << std::endl;
+                std::vector<uint32_t> files;        // Files waiting for blocks, in listing order
+                std::vector<uint32_t> unsorted;     // Directories that had files appended
+                std::string time, path, parent_path;
+                uint32_t parent = NO_INDEX;
+                int size = 0;
+                rest = listing.view();
+                while(nextLine(rest, line)){
+                    parseListingLine(line, size, time, path);
+                    // If filesize is 0 don't bother. Skipping 1 gets rid of the period in front of path name.
+                    if(size == 0 || path.size() < 2) continue;
+                    std::string_view full(path.data()+1, path.size()-1);
+                    // Only paths with spaces, double slashes or a trailing slash need the full clean-up
+                    if(full.find(' ') != std::string_view::npos || full.find("//") != std::string_view::npos || full.back() == '/'){
+                        full = makePathValid(full);
+                        full.remove_suffix(1);          // Remove last slash
+                    }
+                    size_t loc = full.rfind('/');
+                    std::string_view name = full.substr(loc+1);
+                    if(name.empty()) continue;
+                    // Listings are grouped by directory, so the parent is usually the same as last time
+                    std::string_view dir = full.substr(0, loc+1);
+                    if(parent == NO_INDEX || dir != parent_path){
+                        parent_path.assign(dir.data(), dir.size());
+                        parent = getDirectory(parent_path);
+                        if(parent == NO_INDEX) continue;
+                    }
+                    // Appending keeps the children sorted unless the name does not come after the last one
+                    std::vector<uint32_t>& list = childrenOf(parent);
+                    if(!list.empty() && !(nameOf(list.back()) < name) && (unsorted.empty() || unsorted.back() != parent)){
+                        unsorted.push_back(parent);
+                    }
+                    uint32_t new_file = newNode(strings.intern(name), strings.intern(time), parent, size, false);
+                    childrenOf(parent).push_back(new_file);
+                    files.push_back(new_file);
+                }
+
+                // Sort each directory that was appended to. Later files with the same name as an earlier entry are dropped.
+                std::sort(unsorted.begin(), unsorted.end());
+                unsorted.erase(std::unique(unsorted.begin(), unsorted.end()), unsorted.end());
+                for(size_t i = 0; i < unsorted.size(); i++){
+                    std::vector<uint32_t>& list = childrenOf(unsorted[i]);
+                    std::stable_sort(list.begin(), list.end(), NameLess(this));
+                    size_t kept = 0;
+                    for(size_t j = 0; j < list.size(); j++){
+                        if(kept > 0 && nameOf(list[kept-1]) == nameOf(list[j])){
+                            std::cout << "File already exists." << std::endl;
+                            nodes[list[j]].parent = NO_INDEX;   // Freed once the blocks are handed out
+                        }else list[kept++] = list[j];
+                    }
+                    list.resize(kept);
+                }
+
+                std::vector<int> blocks;            // Blocks each waiting file needs
+                for(size_t i = 0; i < files.size(); i++){
+                    const TreeNode& file = nodes[files[i]];
+                    blocks.push_back(file.parent != NO_INDEX && file.size > 0 ? Lfile::blocksFor(file.size) : 0);
+                }
+                std::vector<std::vector<Extent> > extents = LDISK->allocateBatch(blocks);
+                for(size_t i = 0; i < files.size(); i++){
+                    if(nodes[files[i]].parent != NO_INDEX) lfileOf(files[i]).addExtents(extents[i]);
+                    else freeNode(files[i]);
+                }
+                std::cout << "Finished Loading Files!" << std::endl;
+            }
+        }
+
+        // Orders node indexes by name
+        struct NameLess{
+            FileTree* tree;
+            NameLess(FileTree* tree) : tree(tree){}
+            bool operator()(uint32_t a, uint32_t b) const{
+                return tree->nameOf(a) < tree->nameOf(b);
             }
+        };
+
+        // Writes the tree, file extents and disk state to a snapshot image
+        bool save(std::string name){
+            std::vector<SnapshotNode> records;
+            std::vector<Extent> extents;
+            std::vector<Extent> runs;
+
+            // Breadth first, so the children of a directory get consecutive indexes
+            std::vector<uint32_t> order(1, 0);
+            records.push_back(SnapshotNode());
+            records[0].parent = 0;
+            for(size_t i = 0; i < order.size(); i++){
+                const TreeNode& tree = nodes[order[i]];
+                SnapshotNode& record = records[i];
+                record.name = tree.name;
+                record.time = tree.time;
+                record.size = tree.size;
+                record.is_dir = tree.is_dir;
+                record.first_child = order.size();
+                record.child_count = 0;
+                record.first_extent = extents.size();
+                record.extent_count = 0;
+                if(tree.is_dir){
+                    std::vector<uint32_t>& list = children[tree.data];
+                    record.child_count = list.size();
+                    for(size_t c = 0; c < list.size(); c++){
+                        order.push_back(list[c]);
+                        records.push_back(SnapshotNode());
+                        records.back().parent = i;
+                    }
+                }else{
+                    std::vector<Extent>& file_extents = lfiles[tree.data].extents;
+                    records[i].extent_count = file_extents.size();
+                    extents.insert(extents.end(), file_extents.begin(), file_extents.end());
+                }
+            }
+            LDISK->usedExtents(runs);
+
+            SnapshotHeader header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+            header.version = SNAPSHOT_VERSION;
+            header.header_size = sizeof(SnapshotHeader);
+            header.block_size = BLOCKSIZE;
+            header.block_count = LDISK->sumFree() + LDISK->sumOccupied();
+            header.next_fit = LDISK->nextFit();
+            header.node_count = records.size();
+            header.extent_count = extents.size();
+            header.run_count = runs.size();
+            header.string_bytes = strings.size();
+            header.nodes_offset = align8(sizeof(SnapshotHeader));
+            header.extents_offset = align8(header.nodes_offset + records.size()*sizeof(SnapshotNode));
+            header.runs_offset = align8(header.extents_offset + extents.size()*sizeof(Extent));
+            header.strings_offset = align8(header.runs_offset + runs.size()*sizeof(Extent));
+            header.image_size = header.strings_offset + strings.size();
+
+            std::vector<char> image(header.image_size, 0);
+            memcpy(image.data() + header.nodes_offset, records.data(), records.size()*sizeof(SnapshotNode));
+            memcpy(image.data() + header.extents_offset, extents.data(), extents.size()*sizeof(Extent));
+            memcpy(image.data() + header.runs_offset, runs.data(), runs.size()*sizeof(Extent));
+            memcpy(image.data() + header.strings_offset, strings.data(), strings.size());
+            header.checksum = checksum(image.data() + sizeof(SnapshotHeader), image.size() - sizeof(SnapshotHeader));
+            memcpy(image.data(), &header, sizeof(header));
+
+            FILE* out = fopen(name.c_str(), "wb");
+            if(out == NULL) return false;
+            bool written = fwrite(image.data(), 1, image.size(), out) == image.size();
+            return fclose(out) == 0 && written;
+        }
+
+        // Replaces the tree and disk with a snapshot image. The image is memory-mapped and checked in full before anything
+        // is changed, so a bad file leaves the current state alone. The string table becomes the string pool as is and node i
+        // of the image becomes node i of the arena. Returns an error message, or an empty string on success.
+        std::string load(std::string name){
+            MappedFile image;
+            if(!image.open(name) || image.size < sizeof(SnapshotHeader)) return "Could not read snapshot: " + name;
+            SnapshotHeader header;
+            memcpy(&header, image.data, sizeof(header));
+            if(memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) return "Not a snapshot: " + name;
+            if(header.version != SNAPSHOT_VERSION || header.header_size != sizeof(SnapshotHeader)){
+                return "Unsupported snapshot version: " + name;
+            }
+            // Every section has to fit inside the image before anything in it is looked at
+            if(header.image_size != image.size || header.node_count == 0 || header.block_size <= 0 || header.block_count < 0 ||
+               !sectionFits(header.nodes_offset, header.node_count, sizeof(SnapshotNode), image.size) ||
+               !sectionFits(header.extents_offset, header.extent_count, sizeof(Extent), image.size) ||
+               !sectionFits(header.runs_offset, header.run_count, sizeof(Extent), image.size) ||
+               !sectionFits(header.strings_offset, header.string_bytes, 1, image.size) ||
+               header.string_bytes == 0 || image.data[header.strings_offset + header.string_bytes - 1] != '\0'){
+                return "Corrupt snapshot: " + name;
+            }
+            if(checksum(image.data + sizeof(SnapshotHeader), image.size - sizeof(SnapshotHeader)) != header.checksum){
+                return "Snapshot checksum mismatch: " + name;
+            }
+            const SnapshotNode* records = (const SnapshotNode*)(image.data + header.nodes_offset);
+            const Extent* extents = (const Extent*)(image.data + header.extents_offset);
+            const Extent* runs = (const Extent*)(image.data + header.runs_offset);
+            const char* table = image.data + header.strings_offset;
+            // Breadth first order means each node's children start right after the previous node's children
+            uint64_t next_child = 1;
+            for(uint32_t i = 0; i < header.node_count; i++){
+                const SnapshotNode& record = records[i];
+                if(record.name >= header.string_bytes || record.time >= header.string_bytes || (i == 0 && !record.is_dir) ||
+                   record.first_child != next_child || next_child + record.child_count > header.node_count ||
+                   (!record.is_dir && record.child_count > 0) || record.first_extent + record.extent_count > header.extent_count){
+                    return "Corrupt snapshot: " + name;
+                }
+                // Children have to point back at their directory and be in strict name order for lookups to work
+                for(uint32_t c = record.first_child; c < record.first_child + record.child_count; c++){
+                    if(records[c].parent != i || (c > record.first_child &&
+                       !(std::string_view(table + records[c-1].name) < std::string_view(table + records[c].name)))){
+                        return "Corrupt snapshot: " + name;
+                    }
+                }
+                next_child += record.child_count;
+            }
+            if(next_child != header.node_count) return "Corrupt snapshot: " + name;
+            for(uint64_t i = 0; i < header.extent_count + header.run_count; i++){
+                const Extent& extent = i < header.extent_count ? extents[i] : runs[i - header.extent_count];
+                if(extent.start < 0 || extent.length <= 0 || extent.start > header.block_count - extent.length){
+                    return "Corrupt snapshot: " + name;
+                }
+            }
+            if(!extentsInRuns(extents, header.extent_count, runs, header.run_count)) return "Corrupt snapshot: " + name;
+
+            BLOCKSIZE = header.block_size;
+            LDISK->restore(header.block_count, runs, header.run_count, header.next_fit);
+            strings.assign(table, header.string_bytes);
+            nodes.assign(header.node_count, TreeNode());
+            children.clear();
+            lfiles.clear();
+            free_nodes.clear();
+            free_children.clear();
+            free_lfiles.clear();
+            for(uint32_t i = 0; i < header.node_count; i++){
+                const SnapshotNode& record = records[i];
+                TreeNode& tree = nodes[i];
+                tree.name = record.name;
+                tree.time = record.time;
+                tree.parent = record.parent;
+                tree.size = record.size;
+                tree.is_dir = record.is_dir;
+                if(tree.is_dir){
+                    tree.data = children.size();
+                    children.push_back(std::vector<uint32_t>(record.child_count));
+                    for(uint32_t c = 0; c < record.child_count; c++) children.back()[c] = record.first_child + c;
+                }else{
+                    tree.data = lfiles.size();
+                    lfiles.push_back(Lfile());
+                    lfiles.back().addExtents(std::vector<Extent>(extents + record.first_extent, extents + record.first_extent + record.extent_count));
+                }
+            }
+            cur_dir = 0;
+            cur_path = "/";
+            dentries.clear();
+            return "";
+        }
+
+        // Checks that the used runs of a snapshot are in block order without overlapping, and that the file extents lie inside
+        // them without overlapping each other. Otherwise restoring the disk, or freeing a file later, would work on blocks
+        // that aren't in use. Runs that touch count as one, since a file's extent may cover several.
+        bool extentsInRuns(const Extent* extents, uint64_t extent_count, const Extent* runs, uint64_t run_count){
+            for(uint64_t i = 1; i < run_count; i++){
+                if(runs[i].start < runs[i-1].end()) return false;
+            }
+            std::vector<Extent> sorted(extents, extents + extent_count);
+            std::sort(sorted.begin(), sorted.end(), [](const Extent& a, const Extent& b){
+                return a.start < b.start;
+            });
+            uint64_t run = 0;       // First run that doesn't end before the current extent
+            for(size_t i = 0; i < sorted.size(); i++){
+                if(i > 0 && sorted[i].start < sorted[i-1].end()) return false;
+                while(run < run_count && runs[run].end() <= sorted[i].start) run++;
+                if(run == run_count || runs[run].start > sorted[i].start) return false;
+                int covered = runs[run].end();
+                for(uint64_t r = run + 1; covered < sorted[i].end() && r < run_count && runs[r].start == covered; r++) covered = runs[r].end();
+                if(covered < sorted[i].end()) return false;
+            }
+            return true;
+        }
+
+        // Checks that count records of the given size starting at offset lie inside an image of image_size bytes
+        bool sectionFits(uint64_t offset, uint64_t count, uint64_t size, uint64_t image_size){
+            return offset % 8 == 0 && offset <= image_size && count <= (image_size - offset) / size;
         }
 
         // Appends the given number of bytes (amt) from the given file
-        void append(std::string full_path, int amt){
-            full_path = makePathValid(full_path);
-            full_path = full_path.substr(0, full_path.size()-1);    // Remove last slash
-            int loc = full_path.rfind("/");
-            std::string name = full_path.substr(loc+1);             // After last slash
-            std::string path = full_path.substr(0, loc+1);          // Remove root characters
-            TreeNode* dir = getDirectory(path);
-            if(dir != NULL){
-                treeMapIter it = dir->nodes.find(name);
-                if(it == dir->nodes.end()) std::cout << "File does not exist." << std::endl;
+        void append(std::string_view full_path, int amt){
+            std::string_view path, name;
+            splitPath(full_path, path, name);
+            uint32_t dir = getDirectory(path);
+            if(dir != NO_INDEX){
+                uint32_t file = findChild(dir, name);
+                if(file == NO_INDEX) std::cout << "File does not exist." << std::endl;
                 else {
-                    if(!it->second.is_dir) {
-                        it->second.size += amt;
-                        it->second.lfile.updateNumBlocks(it->second.size);
-                        it->second.time = getCurTime();
+                    if(!nodes[file].is_dir) {
+                        nodes[file].size += amt;
+                        lfileOf(file).updateNumBlocks(nodes[file].size);
+                        nodes[file].time = strings.intern(getCurTime());
                     }
                     else std::cout << "This is a directory!" << std::endl;
                 }
@@ -536,48 +1624,36 @@ class FileTree{
         }
 
         // Removes the given number of bytes (amt) from the given file
-        void remove(std::string full_path, int amt){
-            full_path = makePathValid(full_path);
-            full_path = full_path.substr(0, full_path.size()-1);    // Remove last slash
-            int loc = full_path.rfind("/");
-            std::string name = full_path.substr(loc+1);             // After last slash
-            std::string path = full_path.substr(0, loc+1);          // Remove root characters
-            TreeNode* parent = getDirectory(path);
-            if(parent != NULL){
-                treeMapIter it = parent->nodes.find(name);
-                if(it == parent->nodes.end()) std::cout << "File does not exist." << std::endl;
+        void remove(std::string_view full_path, int amt){
+            std::string_view path, name;
+            splitPath(full_path, path, name);
+            uint32_t parent = getDirectory(path);
+            if(parent != NO_INDEX){
+                uint32_t file = findChild(parent, name);
+                if(file == NO_INDEX) std::cout << "File does not exist." << std::endl;
                 else{
-                    if(!it->second.is_dir){
-                        it->second.size -= amt;
-                        if(it->second.size < 0){
-                            it->second.size = 0;
-                        }
-                        it->second.lfile.updateNumBlocks(it->second.size);
-                        it->second.time = getCurTime();
-                    }else  std::cout << "This is a directory!" << std::endl;
+                    if(!nodes[file].is_dir) shrink(file, amt);
+                    else  std::cout << "This is a directory!" << std::endl;
                 }
             }
         }
 
-        void del(std::string full_path){
-            full_path = makePathValid(full_path);
-            full_path = full_path.substr(0, full_path.size()-1);    // Remove last slash
-            int loc = full_path.rfind("/");
-            std::string name = full_path.substr(loc+1);
-            std::string path = full_path.substr(0, loc+1);          // Remove root characters
-            TreeNode* parent = getDirectory(path);
-            if(parent != NULL){
-                treeMapIter it = parent->nodes.find(name);
-                if(it == parent->nodes.end()) std::cout << "Directory or File does not exist." << std::endl;
+        void del(std::string_view full_path){
+            std::string_view path, name;
+            splitPath(full_path, path, name);
+            uint32_t parent = getDirectory(path);
+            if(parent != NO_INDEX){
+                uint32_t node = findChild(parent, name);
+                if(node == NO_INDEX) std::cout << "Directory or File does not exist." << std::endl;
                 else {
-                    if(!it->second.is_dir) {                    // File delete
-                        remove(full_path, it->second.size);
-                        parent->nodes.erase(name);
-                        parent->time = getCurTime();
+                    if(!nodes[node].is_dir) {                   // File delete
+                        shrink(node, nodes[node].size);
+                        removeChild(parent, node);
+                        nodes[parent].time = strings.intern(getCurTime());
                     }else{                                      // Directory delete
-                        if(it->second.nodes.size() > 0) std::cout << "Directory is not empty." << std::endl;
+                        if(childrenOf(node).size() > 0) std::cout << "Directory is not empty." << std::endl;
                         else {
-                            parent->nodes.erase(name);
+                            removeChild(parent, node);
                         }
                     }
                 }
@@ -585,27 +1661,120 @@ class FileTree{
         }
 
         void fragmentation(){
-            std::cout << "fragmentation: " << LDISK.sumOccupied()*BLOCKSIZE-getTotalSize() << " bytes" << std::endl;
+            std::cout << "fragmentation: " << LDISK->sumOccupied()*BLOCKSIZE-getTotalSize() << " bytes" << std::endl;
+        }
+
+        // Prints how well the allocation strategy keeps files and free space contiguous
+        void fragmentationReport(){
+            int files = 0, extents = 0, most = 0;
+            // Counts the files holding blocks and the extents they are split into
+            for(size_t i = 0; i < nodes.size(); i++){
+                if(nodes[i].parent == NO_INDEX || nodes[i].is_dir) continue;
+                int count = lfileOf(i).extents.size();
+                if(count > 0){
+                    files++;
+                    extents += count;
+                    if(count > most) most = count;
+                }
+            }
+            std::cout << "Strategy: " << FIT_NAMES[FIT] << std::endl;
+            std::cout << "Files: " << files << std::endl;
+            std::cout << "Extents per file: " << (files > 0 ? double(extents)/files : 0.0) << " (max " << most << ")" << std::endl;
+            std::cout << "Free extents: " << LDISK->freeExtents() << std::endl;
+            std::cout << "Largest free extent: " << LDISK->largestFree() << " blocks" << std::endl;
+            std::cout << "External fragmentation: " << LDISK->externalFragmentation() << std::endl;
         }
 };
 
-int main(int argc, char* argv[]){
-    if (argc != 9) {
-        std::cout   << "Usage ./assign2 "
-                    << "-f [input file storing information on files] "
-                    << "-d [input file storing information on directories] "
-                    << "-s [disk size] "
-                    << "-b [block size]"
-                    << std::endl;
+// Times the disk backends on the blocks of a file listing with the current -fit strategy and checks that they leave the same
+// prdisk footprint. Also reports how many extents each file ended up in and how fragmented the free space is.
+// The load phase allocates every file in listing order. The churn phase then frees every other file and allocates it again
+// at twice the size, so the allocator has to search a fragmented disk. Each phase is repeated and the fastest run is kept.
+int bench(std::string file_list, int block_count, int repeat){
+    std::vector<int> blocks;    // Blocks of each file in the listing, in order
+    MappedFile files;
+    if(!files.open(file_list)){
+        std::cout << "Could not open " << file_list << std::endl;
         return -1;
     }
+    std::string_view rest = files.view(), line;
+    std::string time, path;
+    int size = 0;
+    while(nextLine(rest, line)){
+        parseListingLine(line, size, time, path);
+        if(size != 0) blocks.push_back(Lfile::blocksFor(size));
+    }
+
+    const char* backends[] = {"list", "bitmap"};
+    std::string footprints[2];
+    printf("%8s %8s %12s %12s %12s %10s %12s %10s\n", "Backend", "Files", "Load ms", "Churn ms", "ns/alloc", "Ext/file",
+           "Largest free", "Ext frag");
+    for(int b = 0; b < 2; b++){
+        double best_load = 0, best_churn = 0;
+        double extents_per_file = 0, fragmentation = 0;
+        int largest = 0;
+        for(int r = 0; r < repeat; r++){
+            Ldisk* disk = makeLdisk(backends[b]);
+            disk->initLdisk(block_count);
+            std::vector<std::vector<Extent> > extents(blocks.size());
+            std::stringstream out;
+            std::streambuf* console = std::cout.rdbuf(out.rdbuf());   // Keeps "NOT ENOUGH SPACE" and the footprint off the table
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for(size_t i = 0; i < blocks.size(); i++) extents[i] = disk->allocate(blocks[i]);
+            std::chrono::steady_clock::time_point loaded = std::chrono::steady_clock::now();
+            for(size_t i = 1; i < blocks.size(); i += 2) disk->free(extents[i]);
+            for(size_t i = 1; i < blocks.size(); i += 2) extents[i] = disk->allocate(2*blocks[i]);
+            std::chrono::steady_clock::time_point churned = std::chrono::steady_clock::now();
+
+            disk->diskFootprint();
+            std::cout.rdbuf(console);
+            footprints[b] = out.str();
+            size_t extent_count = 0;
+            for(size_t i = 0; i < extents.size(); i++) extent_count += extents[i].size();
+            extents_per_file = extents.size() > 0 ? double(extent_count)/extents.size() : 0.0;
+            largest = disk->largestFree();
+            fragmentation = disk->externalFragmentation();
+            delete disk;
+
+            double load = std::chrono::duration<double>(loaded - start).count();
+            double churn = std::chrono::duration<double>(churned - loaded).count();
+            if(r == 0 || load < best_load) best_load = load;
+            if(r == 0 || churn < best_churn) best_churn = churn;
+        }
+        size_t allocs = blocks.size() + blocks.size()/2;
+        printf("%8s %8zu %12.3f %12.3f %12.1f %10.2f %12d %10.4f\n", backends[b], blocks.size(), best_load*1e3, best_churn*1e3,
+               allocs > 0 ? (best_load + best_churn)*1e9/allocs : 0.0, extents_per_file, largest, fragmentation);
+    }
+    std::cout << "prdisk footprints " << (footprints[0] == footprints[1] ? "match" : "DIFFER") << std::endl;
+    return footprints[0] == footprints[1] ? 0 : -1;
+}
+
+// Reads the options of dir and prfiles: an optional "-depth N" followed by an optional directory path
+void listingOptions(std::string options, std::string& path, int& depth){
+    path = "";
+    depth = -1;
+    if(options.substr(0, 7) == "-depth "){
+        std::stringstream ss(options.substr(7));
+        ss >> depth;
+        std::getline(ss >> std::ws, path);
+    }else path = options;
+}
+
+int main(int argc, char* argv[]){
+    // Benchmark mode compares the disk backends instead of starting the shell
+    bool bench_mode = argc > 1 && strcmp(argv[1], "bench") == 0;
 
     // Find the indexies of our flags
-    int findex = 0; // Index of flag -f
-    int dindex = 0; // Index of flag -d
-    int sindex = 0; // Index of flag -s
-    int bindex = 0; // Index of flag -b
-    for(int i = 1; i < argc; i++){
+    int findex = 0;         // Index of flag -f
+    int dindex = 0;         // Index of flag -d
+    int sindex = 0;         // Index of flag -s
+    int bindex = 0;         // Index of flag -b
+    int diskindex = 0;      // Index of flag -disk
+    int repeatindex = 0;    // Index of flag -repeat
+    int fitindex = 0;       // Index of flag -fit
+    int iindex = 0;         // Index of flag -i
+    for(int i = 1; i < argc-1; i++){
         if(strcmp(argv[i], "-f") == 0){
             findex = i;
         }else if(strcmp(argv[i], "-d") == 0){
@@ -614,67 +1783,66 @@ int main(int argc, char* argv[]){
             sindex = i;
         }else if(strcmp(argv[i], "-b") == 0){
             bindex = i;
+        }else if(strcmp(argv[i], "-disk") == 0){
+            diskindex = i;
+        }else if(strcmp(argv[i], "-repeat") == 0){
+            repeatindex = i;
+        }else if(strcmp(argv[i], "-fit") == 0){
+            fitindex = i;
+        }else if(strcmp(argv[i], "-i") == 0){
+            iindex = i;
         }
     }
 
-    // Save all of our argument variables
-    std::string file_list = argv[findex+1];
-    std::string dir_list = argv[dindex+1];
-    int disk_size = atoi(argv[sindex+1]);
-    BLOCKSIZE = atoi(argv[bindex+1]);
-    int block_count = disk_size/BLOCKSIZE;
-
-    LDISK.initLdisk(block_count);
+    std::string backend = diskindex ? argv[diskindex+1] : "list";
+    LDISK = makeLdisk(backend);
+    int fit = 0;
+    if(fitindex){
+        for(fit = 0; fit <= ALIGNED && strcmp(argv[fitindex+1], FIT_NAMES[fit]) != 0; fit++);
+    }
+    FIT = Fit(fit);
+    bool listings = findex != 0 && (dindex != 0 || bench_mode) && sindex != 0 && bindex != 0;
+    if ((!listings && (iindex == 0 || bench_mode)) || LDISK == NULL || fit > ALIGNED) {
+        std::cout   << "Usage ./assign3 "
+                    << "-f [input file storing information on files] "
+                    << "-d [input file storing information on directories] "
+                    << "-s [disk size] "
+                    << "-b [block size] "
+                    << "[-disk list|bitmap] "
+                    << "[-fit scatter|first|next|best|aligned]"
+                    << std::endl
+                    << "Usage ./assign3 -i [snapshot image] [-disk list|bitmap] [-fit scatter|first|next|best|aligned]"
+                    << std::endl
+                    << "Usage ./assign3 bench -f [file list] -s [disk size] -b [block size] [-fit ...] [-repeat N]"
+                    << std::endl;
+        return -1;
+    }
 
     // Directory Tree
     FileTree tree;
 
-    // Set up directories
-    std::string item;
-    std::string path;
-    std::string time;
-    int size;
-    std::ifstream dirs(dir_list);
-    if(dirs.is_open()){
-        while(getline(dirs, path)){
-            // If filesize is 0 don't bother. substr.(1) gets rid of period
-            tree.addDirectory(path.substr(1));
-        }
-    }
-    dirs.close();
-
-
-    // Insert files
-    std::ifstream files(file_list);
-    if(files.is_open()){
-        std::cout << "Loading Files! Hold on, should take a minute." << std::endl;
-        int column; // Keeps track of which column we're currently observing 
-        while(getline(files, item)){
-            std::stringstream ss(item);
-            column = -1;
-            path = "";
-            time = "";
-            while(getline(ss, item, ' ')){
-                if(item.length() != 0){
-                    ++column;
-                    if (column == 6){
-                        std::stringstream integer(item);
-                        integer >> size;
-                    }else if(column == 7 || column == 8 || column == 9){
-                        if(column != 7) time += " ";
-                        time += item;
-                    }else if(column >= 10){
-                        if(column != 10) path += " ";
-                        path += item;
-                    }
-                }
-            }
-            // If filesize is 0 don't bother. substr(1) gets rid of the period in front of path name.
-            if(size != 0) tree.addFile(path.substr(1), size, time);
+    if(iindex){
+        // Start from a snapshot image instead of the listings
+        std::string error = tree.load(argv[iindex+1]);
+        if(error != ""){
+            std::cout << error << std::endl;
+            return -1;
         }
-        std::cout << "Finished Loading Files!" << std::endl;
+    }else{
+        // Save all of our argument variables
+        std::string file_list = argv[findex+1];
+        int disk_size = atoi(argv[sindex+1]);
+        BLOCKSIZE = atoi(argv[bindex+1]);
+        int block_count = disk_size/BLOCKSIZE;
+
+        if(bench_mode) return bench(file_list, block_count, repeatindex ? atoi(argv[repeatindex+1]) : 5);
+
+        std::string dir_list = argv[dindex+1];
+        LDISK->initLdisk(block_count);
+
+        // Set up directories and insert files
+        tree.bulkLoad(dir_list, file_list);
     }
-    files.close();
 
     // Where commands are taken in
     std::string input;
@@ -694,13 +1862,13 @@ int main(int argc, char* argv[]){
         }else if(input.substr(0, 6) == "mkdir "){
             std::stringstream ss(input.substr(6));
             std::getline(ss, token, '\n');
-            std::string new_dir = tree.getCurDir()->path+tree.getCurDir()->name+"/"+token;
+            std::string new_dir = tree.getCurPath()+"/"+token;
             tree.addDirectory(new_dir);
         }else if(input.substr(0, 7) == "create "){
             std::stringstream ss(input.substr(7));
             getline(ss, token, '\n');
             std::string name = token;
-            std::string new_dir = tree.getCurDir()->path+tree.getCurDir()->name+"/"+token;  // New directory to be added
+            std::string new_dir = tree.getCurPath()+"/"+token;  // New directory to be added
             tree.addFile(new_dir, 0, tree.getCurTime());
         }else if(input.substr(0, 7) == "append "){
             std::stringstream ss(input.substr(7));
@@ -724,11 +1892,30 @@ int main(int argc, char* argv[]){
             exit(0);
         }else if(input == "dir"){
             tree.printDir();
+        }else if(input.substr(0, 4) == "dir "){
+            std::string path;
+            int depth;
+            listingOptions(input.substr(4), path, depth);
+            tree.printDir(path, depth);
         }else if(input == "prfiles"){
             tree.printFiles();
+        }else if(input.substr(0, 8) == "prfiles "){
+            std::string path;
+            int depth;
+            listingOptions(input.substr(8), path, depth);
+            tree.printFiles(path, depth);
         }else if(input == "prdisk"){
-            LDISK.diskFootprint();
+            LDISK->diskFootprint();
             tree.fragmentation();
+        }else if(input == "frag"){
+            tree.fragmentationReport();
+        }else if(input.substr(0, 5) == "save "){
+            if(tree.save(input.substr(5))) std::cout << "Saved snapshot to " << input.substr(5) << std::endl;
+            else std::cout << "Could not write snapshot: " << input.substr(5) << std::endl;
+        }else if(input.substr(0, 5) == "load "){
+            std::string error = tree.load(input.substr(5));
+            if(error == "") std::cout << "Loaded snapshot from " << input.substr(5) << std::endl;
+            else std::cout << error << std::endl;
         }else{
             std::cout << "Command not recognized." << std::endl;
         }